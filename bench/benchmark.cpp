@@ -0,0 +1,557 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+Benchmarks of the hot paths: auditor::test, the string and vector
+utilities and the parsing of gpg's colon listing. Keys come from a mock
+in-memory key source, so no keyring and no gpg is needed. Prints ns and
+allocations per key (or entry) and compares with a baseline file; the exit
+status is 1 if something got slower.
+Every case runs several times, each time right after a fixed reference loop.
+Compared is the fastest run relative to the fastest reference run, so a
+slower or busier machine doesn't count as regression; how far the median run
+lies above the fastest is the noise, which widens the threshold.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <set>
+#include <new>
+#include <algorithm>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../src/auditor.hpp"
+#include "../src/vectorutil.hpp"
+#include "../src/stringutil.hpp"
+#include "../src/colonlister.hpp"
+
+using namespace std;
+
+// Count all allocations of the process
+static unsigned long allocations = 0;
+
+void* operator new(size_t size)
+{
+   allocations++;
+   void* p = malloc(size ? size : 1);
+   if ( !p )
+      throw bad_alloc();
+   return p;
+}
+void* operator new[](size_t size)
+{
+   return operator new(size);
+}
+void operator delete(void* p) noexcept
+{
+   free(p);
+}
+void operator delete[](void* p) noexcept
+{
+   free(p);
+}
+void operator delete(void* p, size_t) noexcept
+{
+   free(p);
+}
+void operator delete[](void* p, size_t) noexcept
+{
+   free(p);
+}
+
+// keeps the compiler from optimising the work away
+static volatile long sink = 0;
+
+static const double mintime = 0.1;	// s each run of a case takes at least
+static int repeats = 5;	// runs of every case
+static const int retries = 2;	// measurements again of a case that got slower
+static const int    poolsize = 4096;	// mock keys, used round robin
+static const long   listedkeys = 100000;	// keys in the mock colon listing
+
+// One result
+struct benchresult {
+   double ns;	// per key or entry, fastest of the runs
+   double relative;	// fastest run relative to the fastest reference run
+   double noise;	// how much slower the median run is than the fastest, in %
+   double allocs;	// per key or entry
+};
+
+
+/*
+A small, fast and reproducible random generator (xorshift64*)
+*/
+class mockrandom{
+
+  public:
+    mockrandom(unsigned long long seed) : state(seed) {}
+    unsigned long long next() {
+       state ^= state >> 12;
+       state ^= state << 25;
+       state ^= state >> 27;
+       return state * 2685821657736338717ULL;
+    }
+    // true with probability 'percent'/100
+    bool chance(int percent) {
+       return (int) (next() % 100) < percent;
+    }
+
+  private:
+    unsigned long long state;
+};
+
+static string hexid(mockrandom& random, int length)
+{
+   static const char hex[] = "0123456789ABCDEF";
+   string id(length, '0');
+   for ( int i = 0; i < length; i++ )
+      id[i] = hex[random.next() % 16];
+   return id;
+}
+
+/*
+Keys as found in a typical keyring collected from keyservers: most are
+of unknown validity and trust, many expired, some revoked
+*/
+static void mockkeys(vector<keyrecord>& keys, int count)
+{
+   static const int validities[] = { 70, 5, 1, 4, 15, 5 };	// % per gpgme_validity_t
+   static const char* domains[] = { "example.org", "example.com", "mail.example.net",
+                                    "users.example.org", "example.de" };
+   mockrandom random(42);
+   keys.resize(count);
+   for ( int k = 0; k < count; k++ ) {
+      keyrecord& key = keys[k];
+      key.revoked = random.chance(3);
+      key.expired = random.chance(20);
+      key.invalid = random.chance(1);
+      key.disabled = false;
+      key.secret  = random.chance(1);
+      key.created = 1000000000 + random.next() % 700000000;
+      int roll = random.next() % 100, v = 0;
+      while ( v < 5 && roll >= validities[v] )
+         roll -= validities[v++];
+      key.validity    = v;
+      key.owner_trust = random.chance(90) ? 0 : random.next() % 6;
+      key.keyid = hexid(random, 16);
+      key.fpr   = hexid(random, 24) + key.keyid;
+      key.uids.clear();
+      key.emails.clear();
+      key.emailvalidity.clear();
+      int uids = 1 + (random.chance(40) ? random.next() % 4 : 0);
+      for ( int u = 0; u < uids; u++ ) {
+         string email = "user" + NumberToString(random.next() % 100000) + "@"
+                      + domains[random.next() % 5];
+         key.uids.push_back("Some User <" + email + ">");
+         key.emails.push_back(email);
+         key.emailvalidity.push_back(v);
+      }
+   }
+}
+
+/*
+A sorted list of 'size' short key-ids as readvector returns it, about half
+of the mock keys are in it
+*/
+static void mocklist(const vector<keyrecord>& keys, long size, vector<string>& list)
+{
+   mockrandom random(size);
+   list.clear();
+   list.reserve(size);
+   for ( long i = 0; i < size; i++ )
+      if ( i % 2 == 0 && i / 2 < (long) keys.size() )
+         list.push_back(keys[i / 2].keyid.substr(8, 16));
+      else
+         list.push_back(hexid(random, 8));
+   sort(list.begin(), list.end());
+}
+
+/*
+The keys as gpg --with-colons --fixed-list-mode lists them
+*/
+static void mockcolons(const vector<keyrecord>& keys, long count, string& listing)
+{
+   static const char validities[] = "-qnmfu";
+   char line[512];
+   listing = "tru::1:1700000000:0:3:1:5\n";
+   for ( long k = 0; k < count; k++ ) {
+      const keyrecord& key = keys[k % poolsize];
+      char trust = key.revoked ? 'r' : key.expired ? 'e' : validities[key.validity];
+      snprintf(line, sizeof(line), "pub:%c:4096:1:%s:%ld:::%c:::scESC:::::::23::0:\n"
+                                   "fpr:::::::::%s:\n", trust, key.keyid.c_str(),
+               key.created, validities[key.owner_trust], key.fpr.c_str());
+      listing += line;
+      for ( vector<string>::size_type u = 0; u < key.uids.size(); u++ ) {
+         snprintf(line, sizeof(line), "uid:%c::::%ld::0123456789ABCDEF0123456789ABCDEF01234567::"
+                                      "%s::::::::::0:\n", validities[key.validity],
+                  key.created, key.uids[u].c_str());
+         listing += line;
+      }
+      snprintf(line, sizeof(line), "sub:%c:4096:1:%s:%ld::::::e:::::::23:\n"
+                                   "fpr:::::::::%s:\n", trust, key.keyid.c_str(),
+               key.created, key.fpr.c_str());
+      listing += line;
+   }
+}
+
+static double seconds()
+{
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*
+Run 'operation' for more and more keys, starting with n, until it takes at
+least 'mintime'; n is kept for the next run.
+'operation(n)' processes at least n keys and returns how many
+*/
+template<class Operation>
+static benchresult once(Operation operation, long& n)
+{
+   benchresult result;
+   for ( ; ; n *= 2 ) {
+      unsigned long allocated = allocations;
+      double begin = seconds();
+      long done = operation(n);
+      double elapsed = seconds() - begin;
+      if ( elapsed >= mintime || n >= (1L << 40) ) {
+         result.ns     = elapsed * 1e9 / done;
+         result.allocs = (double) (allocations - allocated) / done;
+         return result;
+      }
+   }
+}
+
+/*
+The reference: FNV-1a over 64 bytes per key, only arithmetic and loads from
+the cache, nothing of gpgkeymgr
+*/
+static long reference(long n)
+{
+   static unsigned char data[16384];
+   static bool filled = false;
+   if ( !filled ) {
+      mockrandom random(7);
+      for ( size_t i = 0; i < sizeof(data); i++ )
+         data[i] = random.next();
+      filled = true;
+   }
+   unsigned int hash = 2166136261U;
+   for ( long i = 0; i < n; i++ )
+      for ( size_t j = (i * 64) % sizeof(data), end = j + 64; j < end; j++ )
+         hash = (hash ^ data[j]) * 16777619U;
+   sink += hash;
+   return n;
+}
+
+/*
+Run 'operation' 'repeats' times, each time after the reference; noise only
+ever adds time, so the fastest runs count
+*/
+template<class Operation>
+static benchresult measure(Operation operation)
+{
+   static long referencen = 1;
+   long n = 1;
+   vector<double> ns, base;
+   benchresult result;
+   for ( int run = 0; run < repeats; run++ ) {
+      base.push_back(once(reference, referencen).ns);
+      result = once(operation, n);
+      ns.push_back(result.ns);
+   }
+   sort(ns.begin(), ns.end());
+   sort(base.begin(), base.end());
+   result.ns       = ns[0];
+   result.relative = ns[0] / base[0];
+   result.noise    = (ns[ns.size() / 2] / ns[0] - 1) * 100;
+   return result;
+}
+
+static auditor mockauditor(bool revoked, bool expired, bool novalid, bool poslist,
+                           const vector<string>& list)
+{
+   auditor keyauditor;
+   vector<string> none;
+   keyauditor.setvalues(true, revoked, expired, novalid, 1, false, 0, poslist, list,
+                        false, none, false, uidmatcher(), false);
+   return keyauditor;
+}
+
+/*
+Measure the case 'name' if it is in 'only' or 'only' is empty
+*/
+template<class Operation>
+static void run(const string& name, const set<string>& only, map<string, benchresult>& results,
+                Operation operation)
+{
+   if ( only.empty() || only.count(name) )
+      results[name] = measure(operation);
+}
+
+/*
+All benchmarks (or those in 'only'), sizes of the lists from 10 up to 'maxsize'
+*/
+static void runall(long maxsize, const set<string>& only, map<string, benchresult>& results)
+{
+   vector<keyrecord> keys;
+   mockkeys(keys, poolsize);
+   vector<string> none, list;
+
+   auditor flags = mockauditor(true, true, true, false, none);
+   run("auditor_test_flags", only, results, [&](long n) {
+      for ( long i = 0; i < n; i++ )
+         sink += flags.test(keys[i % poolsize]);
+      return n;
+   });
+
+   run("shortenuid", only, results, [&](long n) {
+      for ( long i = 0; i < n; i++ )
+         sink += shortenuid(keys[i % poolsize].keyid).size();
+      return n;
+   });
+
+   run("replace_string", only, results, [&](long n) {
+      for ( long i = 0; i < n; i++ )
+         sink += replace_string(keys[i % poolsize].uids[0], "@", " at ").size();
+      return n;
+   });
+
+   // parsing in this thread and with the threads of the lister
+   string listing;
+   mockcolons(keys, listedkeys, listing);
+   run("colonlister_parse", only, results, [&](long n) {
+      long done = 0;
+      while ( done < n ) {
+         vector<keyrecord> parsed;
+         colonlister::parse(listing.data(), listing.data() + listing.size(), parsed);
+         done += parsed.size();
+      }
+      return done;
+   });
+   char colonfile[] = "/tmp/gpgkeymgr-bench.XXXXXX";
+   int colonfd = mkstemp(colonfile);
+   if ( colonfd >= 0 && write(colonfd, listing.data(), listing.size()) == (ssize_t) listing.size() ) {
+      run("colonlister_threads", only, results, [&](long n) {
+         long done = 0;
+         keyrecord record;
+         while ( done < n ) {
+            colonlister lister;
+            lister.startfd(open(colonfile, O_RDONLY));
+            while ( lister.next(record) )
+               done++;
+            lister.finish();
+         }
+         return done;
+      });
+   }
+   if ( colonfd >= 0 ) {
+      close(colonfd);
+      unlink(colonfile);
+   }
+
+   for ( long size = 10; size <= maxsize; size *= 10 ) {
+      string suffix = "/" + NumberToString(size);
+      mocklist(keys, size, list);
+
+      auditor listed = mockauditor(false, false, false, true, list);
+      run("auditor_test_list" + suffix, only, results, [&](long n) {
+         for ( long i = 0; i < n; i++ )
+            sink += listed.test(keys[i % poolsize]);
+         return n;
+      });
+
+      run("searchvector" + suffix, only, results, [&](long n) {
+         for ( long i = 0; i < n; i++ )
+            sink += searchvector(list, keys[i % poolsize].keyid.substr(8, 16));
+         return n;
+      });
+
+      // per entry of the file
+      char file[] = "/tmp/gpgkeymgr-bench.XXXXXX";
+      int fd = mkstemp(file);
+      if ( fd < 0 )
+         continue;
+      close(fd);
+      ofstream out(file);
+      for ( long i = 0; i < size; i++ )
+         out << keys[i % poolsize].keyid << "\n";
+      out.close();
+      run("readvector" + suffix, only, results, [&](long n) {
+         long done = 0;
+         while ( done < n ) {
+            vector<string> read;
+            readvector(file, read);
+            sink += read.size();
+            done += size;
+         }
+         return done;
+      });
+      unlink(file);
+   }
+}
+
+/*
+Baseline file: one line per case, "name relative noise allocs ns"
+The ns are only for reading, they depend on the machine.
+*/
+static int readbaseline(string file, map<string, benchresult>& baseline)
+{
+   ifstream in(file.c_str());
+   if ( !in )
+      return 1;
+   string line, name;
+   while ( getline(in, line) ) {
+      istringstream fields(line);
+      benchresult result;
+      if ( !(fields >> name >> result.relative >> result.noise >> result.allocs >> result.ns) ) {
+         baseline.clear();
+         return 1;
+      }
+      baseline[name] = result;
+   }
+   return 0;
+}
+
+static int writebaseline(string file, const map<string, benchresult>& results)
+{
+   FILE* out = fopen(file.c_str(), "w");
+   if ( !out ) {
+      cerr << "Can't write " << file << endl;
+      return 1;
+   }
+   for ( map<string, benchresult>::const_iterator it = results.begin(); it != results.end(); it++ )
+      fprintf(out, "%s %.4f %.1f %.2f %.2f\n", it->first.c_str(), it->second.relative,
+              it->second.noise, it->second.allocs, it->second.ns);
+   return fclose(out) != 0;
+}
+
+/*
+How much slower 'now' is than 'base' (in %) and how much it may be
+*/
+static double change(const benchresult& now, const benchresult& base, double threshold,
+                     double& allowed)
+{
+   allowed = threshold + base.noise + now.noise;
+   return (now.relative / base.relative - 1) * 100;
+}
+
+static bool slower(const benchresult& now, const benchresult& base, double threshold)
+{
+   double allowed;
+   return change(now, base, threshold, allowed) > allowed || now.allocs > base.allocs + 0.01;
+}
+
+/*
+The cases slower than the baseline
+*/
+static set<string> regressions(const map<string, benchresult>& results,
+                               const map<string, benchresult>& baseline, double threshold)
+{
+   set<string> names;
+   for ( map<string, benchresult>::const_iterator it = results.begin(); it != results.end(); it++ ) {
+      map<string, benchresult>::const_iterator base = baseline.find(it->first);
+      if ( base != baseline.end() && base->second.relative > 0
+           && slower(it->second, base->second, threshold) )
+         names.insert(it->first);
+   }
+   return names;
+}
+
+static void help()
+{
+   cout << "gpgkeymgr-bench [--max N] [--repeat N] [--baseline file] [--save file] [--threshold %]\n"
+        << "\t--max N\t\tlargest list size (default 10000000)\n"
+        << "\t--repeat N\truns of every case (default 5)\n"
+        << "\t--baseline file\tcompare with this baseline\n"
+        << "\t--save file\tsave the results as new baseline\n"
+        << "\t--threshold %\tslowdown which counts as regression, on top of the\n"
+        << "\t\t\tnoise of both measurements (default 10)\n";
+}
+
+int main(int argc, char *argv[])
+{
+   long maxsize = 10000000;
+   string baselinefile, savefile;
+   double threshold = 10;
+   static const struct option longopts[] = {
+      { "max",       required_argument, 0, 'm' },
+      { "repeat",    required_argument, 0, 'r' },
+      { "baseline",  required_argument, 0, 'b' },
+      { "save",      required_argument, 0, 's' },
+      { "threshold", required_argument, 0, 't' },
+      { "help",      no_argument,       0, 'h' },
+      { 0, 0, 0, 0 }
+   };
+   int c;
+   while ( (c = getopt_long(argc, argv, "m:r:b:s:t:h", longopts, NULL)) != -1 )
+      switch ( c ) {
+         case 'm': maxsize = atol(optarg); break;
+         case 'r': repeats = max(1, atoi(optarg)); break;
+         case 'b': baselinefile = optarg; break;
+         case 's': savefile = optarg; break;
+         case 't': threshold = atof(optarg); break;
+         case 'h': help(); return 0;
+         default:  help(); return 2;
+      }
+
+   map<string, benchresult> results, baseline;
+   if ( baselinefile != "" && readbaseline(baselinefile, baseline) )
+      cerr << "No usable baseline " << baselinefile << ", only measuring" << endl;
+   set<string> all;
+   runall(maxsize, all, results);
+   // A busy moment of the machine can last longer than the runs of one case,
+   // so only what stays slower counts; noise only ever adds time
+   for ( int retry = 0; retry < retries; retry++ ) {
+      set<string> again = regressions(results, baseline, threshold);
+      if ( again.empty() )
+         break;
+      map<string, benchresult> remeasured;
+      runall(maxsize, again, remeasured);
+      for ( map<string, benchresult>::const_iterator it = remeasured.begin(); it != remeasured.end(); it++ )
+         if ( it->second.relative < results[it->first].relative )
+            results[it->first] = it->second;
+   }
+
+   set<string> slowernames = regressions(results, baseline, threshold);
+   printf("%-28s %14s %12s %7s %10s %10s %8s\n", "benchmark", "ns/key", "relative", "noise",
+          "allocs/key", "change", "allowed");
+   for ( map<string, benchresult>::const_iterator it = results.begin(); it != results.end(); it++ ) {
+      printf("%-28s %14.2f %12.4f %6.1f%% %10.2f", it->first.c_str(), it->second.ns,
+             it->second.relative, it->second.noise, it->second.allocs);
+      map<string, benchresult>::const_iterator base = baseline.find(it->first);
+      if ( base != baseline.end() && base->second.relative > 0 ) {
+         double allowed;
+         double percent = change(it->second, base->second, threshold, allowed);
+         printf(" %+9.1f%% %7.1f%%%s", percent, allowed,
+                slowernames.count(it->first) ? "  REGRESSION" : "");
+      }
+      printf("\n");
+   }
+   if ( savefile != "" && writebaseline(savefile, results) )
+      return 2;
+   return !slowernames.empty();
+}
@@ -0,0 +1,244 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+The two ways to list the keys against each other: gpgme_op_keylist_next,
+which builds a gpgme_key_t for every key, and the colonlister, which parses
+gpg's colon listing on several threads. Both list the same keyring, a
+throwaway one with generated keys unless one is given. Needs gpg and gpgme,
+so unlike the benchmarks of the hot paths it has no baseline.
+*/
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <gpgme.h>
+
+#include "../src/colonlister.hpp"
+
+using namespace std;
+
+static const int runs = 3;	// listings of each way, the fastest counts
+
+static double seconds()
+{
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*
+Run a program and wait for it, returns 0 if it succeeded
+*/
+static int runprogram(const vector<string>& args)
+{
+   vector<char*> argv;
+   for ( vector<string>::size_type i = 0; i < args.size(); i++ )
+      argv.push_back((char*) args[i].c_str());
+   argv.push_back(NULL);
+   pid_t pid = fork();
+   if ( pid < 0 )
+      return 1;
+   if ( pid == 0 ) {
+      execvp(argv[0], &argv[0]);
+      _exit(127);
+   }
+   int status;
+   if ( waitpid(pid, &status, 0) != pid )
+      return 1;
+   return !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+
+/*
+Make a new keyring 'home' with 'count' keys, each with a user-id and an
+encryption subkey, all by one gpg
+*/
+static int generate(string gpg, long count, string& home)
+{
+   char dir[] = "/tmp/gpgkeymgr-listing.XXXXXX";
+   if ( !mkdtemp(dir) )
+      return 1;
+   home = dir;
+   string params = home + "/params";
+   FILE* out = fopen(params.c_str(), "w");
+   if ( !out )
+      return 1;
+   for ( long i = 0; i < count; i++ )
+      fprintf(out, "%%no-protection\nKey-Type: eddsa\nKey-Curve: ed25519\n"
+                   "Subkey-Type: ecdh\nSubkey-Curve: cv25519\n"
+                   "Name-Real: Listing Key %ld\nName-Email: key%ld@example.org\n"
+                   "Expire-Date: 0\n%%commit\n", i, i);
+   if ( fclose(out) != 0 )
+      return 1;
+   vector<string> args;
+   args.push_back(gpg);
+   args.push_back("--homedir");
+   args.push_back(home);
+   args.push_back("--batch");
+   args.push_back("--quiet");
+   args.push_back("--gen-key");
+   args.push_back(params);
+   return runprogram(args);
+}
+
+/*
+Stop the agent of the throwaway keyring and remove it
+*/
+static void removehome(string home)
+{
+   vector<string> args;
+   args.push_back("gpgconf");
+   args.push_back("--homedir");
+   args.push_back(home);
+   args.push_back("--kill");
+   args.push_back("all");
+   runprogram(args);
+   args.clear();
+   args.push_back("rm");
+   args.push_back("-rf");
+   args.push_back(home);
+   runprogram(args);
+}
+
+/*
+List all keys with gpgme, returns how many or -1 on an error
+*/
+static long listgpgme(string gpg, string home)
+{
+   gpgme_ctx_t ctx;
+   if ( gpgme_new(&ctx) != GPG_ERR_NO_ERROR )
+      return -1;
+   gpgme_error_t err = gpgme_ctx_set_engine_info(ctx, GPGME_PROTOCOL_OpenPGP, gpg.c_str(),
+                                                 home.c_str());
+   if ( !err )
+      err = gpgme_set_ctx_flag(ctx, "no-auto-check-trustdb", "1");
+   if ( !err )
+      err = gpgme_op_keylist_start(ctx, NULL, 0);
+   long keys = 0;
+   gpgme_key_t key;
+   while ( !err && !(err = gpgme_op_keylist_next(ctx, &key)) ) {
+      keys++;
+      gpgme_key_unref(key);
+   }
+   gpgme_release(ctx);
+   return gpg_err_code(err) == GPG_ERR_EOF ? keys : -1;
+}
+
+/*
+List all keys with the colonlister, returns how many or -1 on an error
+*/
+static long listcolons(string gpg, string home)
+{
+   colonlister lister;
+   if ( lister.start(gpg, home, false) )
+      return -1;
+   long keys = 0;
+   keyrecord record;
+   while ( lister.next(record) )
+      keys++;
+   return lister.finish() ? -1 : keys;
+}
+
+static void help()
+{
+   cout << "gpgkeymgr-listbench [--keys N] [--home dir]\n"
+        << "\t--keys N\tkeys of the generated keyring (default 1000)\n"
+        << "\t--home dir\tlist this keyring instead, it is not changed\n";
+}
+
+int main(int argc, char *argv[])
+{
+   long count = 1000;
+   string home;
+   static const struct option longopts[] = {
+      { "keys", required_argument, 0, 'k' },
+      { "home", required_argument, 0, 'd' },
+      { "help", no_argument,       0, 'h' },
+      { 0, 0, 0, 0 }
+   };
+   int c;
+   while ( (c = getopt_long(argc, argv, "k:d:h", longopts, NULL)) != -1 )
+      switch ( c ) {
+         case 'k': count = atol(optarg); break;
+         case 'd': home = optarg; break;
+         case 'h': help(); return 0;
+         default:  help(); return 2;
+      }
+
+   gpgme_check_version(NULL);
+   gpgme_engine_info_t enginfo;
+   if ( gpgme_get_engine_info(&enginfo) != GPG_ERR_NO_ERROR )
+      return 2;
+   while ( enginfo && enginfo->protocol != GPGME_PROTOCOL_OpenPGP )
+      enginfo = enginfo->next;
+   if ( !enginfo || !enginfo->file_name ) {
+      cerr << "No gpg found" << endl;
+      return 2;
+   }
+   string gpg = enginfo->file_name;
+
+   bool generated = home == "";
+   if ( generated ) {
+      double begin = seconds();
+      if ( generate(gpg, count, home) ) {
+         cerr << "Can't generate the keyring" << endl;
+         if ( home != "" )
+            removehome(home);
+         return 2;
+      }
+      printf("%ld keys generated in %s in %.1f s\n", count, home.c_str(), seconds() - begin);
+   }
+
+   // the first listing of each way fills the caches and isn't counted
+   double gpgmetime = 0, colonstime = 0;
+   long gpgmekeys = 0, colonskeys = 0;
+   for ( int run = 0; run <= runs; run++ ) {
+      double begin = seconds();
+      gpgmekeys = listgpgme(gpg, home);
+      double elapsed = seconds() - begin;
+      if ( run == 1 || (run > 1 && elapsed < gpgmetime) )
+         gpgmetime = elapsed;
+      begin = seconds();
+      colonskeys = listcolons(gpg, home);
+      elapsed = seconds() - begin;
+      if ( run == 1 || (run > 1 && elapsed < colonstime) )
+         colonstime = elapsed;
+      if ( gpgmekeys <= 0 || gpgmekeys != colonskeys )
+         break;
+   }
+   if ( generated )
+      removehome(home);
+   if ( gpgmekeys <= 0 || gpgmekeys != colonskeys ) {
+      cerr << "Listing failed: gpgme " << gpgmekeys << " keys, colonlister " << colonskeys
+           << " keys" << endl;
+      return 1;
+   }
+
+   printf("%-12s %10s %12s\n", "listing", "ms", "us/key");
+   printf("%-12s %10.1f %12.2f\n", "gpgme", gpgmetime * 1e3, gpgmetime * 1e6 / gpgmekeys);
+   printf("%-12s %10.1f %12.2f\n", "colonlister", colonstime * 1e3, colonstime * 1e6 / colonskeys);
+   printf("colonlister: %.2f times as fast for %ld keys\n", gpgmetime / colonstime, gpgmekeys);
+   return 0;
+}
@@ -34,7 +34,8 @@ using namespace std;
 auditor::auditor()
 : auditor_revoked(false), auditor_expired(false), auditor_novalid(false), 
   auditor_max_valid(0), auditor_notrust(false), auditor_max_trust(0),
-  auditor_altern(false), auditor_poslist(false), auditor_neglist(false)
+  auditor_altern(false), auditor_poslist(false), auditor_neglist(false),
+  auditor_uidmatch(false), auditor_superseded(false), auditor_index(NULL)
   {}
 
 /*
@@ -42,7 +43,8 @@ Set values of the Auditor-variables
 */
 void auditor::setvalues (bool altern, bool revoked, bool expired, bool novalid,
 					int max_valid, bool notrust, int max_trust, bool poslist,
-				 	vector<string> list_pos, bool neglist, vector<string> list_neg) {
+				 	vector<string> list_pos, bool neglist, vector<string> list_neg,
+					bool uidmatch, uidmatcher uidpatterns, bool superseded) {
    auditor_revoked   = revoked;
    auditor_expired   = expired;
    auditor_novalid   = novalid;
@@ -54,13 +56,44 @@ void auditor::setvalues (bool altern, bool revoked, bool expired, bool novalid,
    auditor_list_pos  = list_pos;
    auditor_neglist   = neglist;
    auditor_list_neg  = list_neg;
+   auditor_uidmatch  = uidmatch;
+   auditor_uidpatterns = uidpatterns;
+   auditor_superseded  = superseded;
+}
+
+/*
+Test if any test is set, without tests the auditor selects every key
+*/
+bool auditor::hastests() {
+   return auditor_revoked || auditor_expired || auditor_novalid || auditor_notrust
+          || auditor_poslist || auditor_neglist || auditor_uidmatch || auditor_superseded;
+}
+
+/*
+Test if the decision needs an index of all mail addresses of the keyring
+*/
+bool auditor::needsindex() {
+   return auditor_superseded;
+}
+
+/*
+Set the index of mail addresses used to find superseded keys
+*/
+void auditor::setindex(const emailindex* index) {
+   auditor_index = index;
 }
 
 /*
 Main function:
 test if a key should be deleted according to the specified options
 */
-bool auditor::test(bool revoked, bool expired, int validity, int owner_trust, string keyid) {
+bool auditor::test(const keyrecord& key) {
+         bool revoked    = key.revoked;
+         bool expired    = key.expired;
+         int validity    = key.validity;
+         int owner_trust = key.owner_trust;
+         const string& keyid = key.keyid;
+
          /* Test if to remove key */
          if ( auditor_altern ) { // any given criteria induce deletion
             if ( auditor_revoked && revoked ) 
@@ -74,6 +107,10 @@ bool auditor::test(bool revoked, bool expired, int validity, int owner_trust, st
             else if ( auditor_poslist && 
                         searchvector(auditor_list_pos, shortenuid(keyid))  ) 
                return true;
+            else if ( auditor_uidmatch && auditor_uidpatterns.matchall(key.uids, key.emails) )
+               return true;
+            else if ( auditor_superseded && auditor_index && auditor_index->superseded(key) )
+               return true;
          }
          else { // all given criteria together induce deletion
             if ( (!auditor_revoked || ( auditor_revoked && revoked )) &&
@@ -83,7 +120,11 @@ bool auditor::test(bool revoked, bool expired, int validity, int owner_trust, st
                  (!auditor_poslist || ( auditor_poslist &&
                           searchvector(auditor_list_pos, shortenuid(keyid))) ) &&
                  (!auditor_neglist || ( auditor_neglist &&
-                          !searchvector(auditor_list_neg, shortenuid(keyid))) )
+                          !searchvector(auditor_list_neg, shortenuid(keyid))) ) &&
+                 (!auditor_uidmatch || ( auditor_uidmatch &&
+                          auditor_uidpatterns.matchall(key.uids, key.emails)) ) &&
+                 (!auditor_superseded || ( auditor_superseded && auditor_index &&
+                          auditor_index->superseded(key)) )
                ) {
                  return true;
                  }
@@ -94,13 +135,20 @@ bool auditor::test(bool revoked, bool expired, int validity, int owner_trust, st
 /*
 Generate a security-question
 */
-string auditor::generatequestion() {
+string auditor::generatequestion(bool prune) {
    string mode;
    if (auditor_altern)
       mode = _(" or ");
    else
       mode = _(" and ");
-   string question = _("Do you really want to delete all keys which are ");
+   // pruning replaces deleting, the keys stay in the keyring
+   string question = prune ? _("Do you really want to prune (strip subkeys, user-ids and "
+                               "signatures, but not delete) all keys which are ")
+                           : _("Do you really want to delete all keys which are ");
+   if ( prune && !auditor_revoked && !auditor_expired && !auditor_novalid && !auditor_notrust
+        && !auditor_poslist && !auditor_uidmatch && !auditor_superseded )
+      return _("Do you really want to prune (strip subkeys, user-ids and signatures, "
+               "but not delete) all keys?");
    if ( auditor_revoked )
       question += _("revoked")        + mode;
    if ( auditor_expired )
@@ -111,6 +159,10 @@ string auditor::generatequestion() {
       question += _("untrusted") + string(" (≤") + NumberToString(auditor_max_trust) + ")" + mode;
    if ( auditor_poslist )
       question += _("listed in file") + mode;
+   if ( auditor_uidmatch )
+      question += _("matching the user-id patterns") + mode;
+   if ( auditor_superseded )
+      question += _("superseded by a newer key") + mode;
    // remove last 'and':
    question = question.substr(0, question.length()-mode.length());
    // for languages which need also something at the end of the questions:
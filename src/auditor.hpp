@@ -19,6 +19,9 @@
 
 #include <vector>
 #include <string>
+#include "keyrecord.hpp"
+#include "uidmatcher.hpp"
+#include "emailindex.hpp"
 using namespace std;
 
 #ifndef _auditor_hpp_
@@ -28,9 +31,13 @@ class auditor{
   
   public:
     auditor();
-    void setvalues(bool, bool, bool, bool, int, bool, int, bool, vector<string>, bool, vector<string>);
-    bool test(bool, bool, int, int, string);
-    string generatequestion();
+    void setvalues(bool, bool, bool, bool, int, bool, int, bool, vector<string>, bool, vector<string>,
+                   bool, uidmatcher, bool);
+    bool hastests();
+    bool needsindex();
+    void setindex(const emailindex*);
+    bool test(const keyrecord&);
+    string generatequestion(bool prune = false);
     
   private:
     bool auditor_revoked;	// delete keys that are revoked
@@ -40,6 +47,8 @@ class auditor{
     bool auditor_altern;	// treat arguments as alternative
     bool auditor_poslist;	vector<string> auditor_list_pos;	// List of keys to delete
     bool auditor_neglist;	vector<string> auditor_list_neg;	// List of keys NOT to delete
+    bool auditor_uidmatch;	uidmatcher auditor_uidpatterns;	// Patterns all user-ids must match
+    bool auditor_superseded;	const emailindex* auditor_index;	// delete keys with a newer valid key
 };
 
 
@@ -0,0 +1,150 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <unistd.h>
+#include <libintl.h>
+
+#include "checkpoint.hpp"
+
+#define _(Text) gettext(Text) // _ as short version of gettext
+
+using namespace std;
+
+// First line of every checkpoint-file
+static const string magic = "gpgkeymgr-checkpoint 1";
+
+
+checkpoint::checkpoint(string file)
+: cursor(""), done(false), checkpoint_file(file), checkpoint_count(0),
+  checkpoint_revoked(0), checkpoint_expired(0)
+{
+   for ( int i=0; i<6; i++)
+      for ( int j=0; j<6; j++)
+         checkpoint_numberofkeys[i][j]=0;
+}
+
+/*
+Read the checkpoint from its file
+*/
+int checkpoint::load()
+{
+   ifstream ifs( checkpoint_file.c_str() );
+   if (! ifs) {
+      cerr << _("Failed to open ") << checkpoint_file << endl;
+      return 1;
+   }
+
+   string s;
+   if ( !getline(ifs, s) || s != magic ) {
+      cerr << _("Not a checkpoint-file: ") << checkpoint_file << endl;
+      return 1;
+   }
+   pending.clear();
+   while (getline(ifs, s)) {
+      istringstream line(s);
+      string field;
+      line >> field;
+      if ( field == "cursor" )
+         line >> cursor;
+      else if ( field == "done" )
+         done = true;
+      else if ( field == "count" )
+         line >> checkpoint_count;
+      else if ( field == "revoked" )
+         line >> checkpoint_revoked;
+      else if ( field == "expired" )
+         line >> checkpoint_expired;
+      else if ( field == "matrix" ) {
+         for ( int i=0; i<6; i++)
+            for ( int j=0; j<6; j++)
+               line >> checkpoint_numberofkeys[i][j];
+      }
+      else if ( field == "pending" ) {
+         line >> field;
+         pending.push_back(field);
+      }
+      if ( line.fail() ) {
+         cerr << _("Not a checkpoint-file: ") << checkpoint_file << endl;
+         return 1;
+      }
+   }
+   return 0;
+}
+
+/*
+Write the checkpoint, the old one is replaced atomically
+*/
+int checkpoint::save()
+{
+   string tmpfile = checkpoint_file + ".tmp";
+   ofstream ofs( tmpfile.c_str() );
+   ofs << magic << "\n";
+   if ( cursor != "" )
+      ofs << "cursor " << cursor << "\n";
+   if ( done )
+      ofs << "done\n";
+   ofs << "count "   << checkpoint_count   << "\n";
+   ofs << "revoked " << checkpoint_revoked << "\n";
+   ofs << "expired " << checkpoint_expired << "\n";
+   ofs << "matrix";
+   for ( int i=0; i<6; i++)
+      for ( int j=0; j<6; j++)
+         ofs << " " << checkpoint_numberofkeys[i][j];
+   ofs << "\n";
+   for ( vector<string>::size_type i = 0; i < pending.size(); i++ )
+      ofs << "pending " << pending[i] << "\n";
+   ofs.close();
+   if ( ofs.fail() || rename(tmpfile.c_str(), checkpoint_file.c_str()) != 0 ) {
+      cerr << _("Can't write checkpoint-file ") << checkpoint_file << endl;
+      return 1;
+   }
+   return 0;
+}
+
+/*
+Remove the file once the run is complete
+*/
+int checkpoint::remove()
+{
+   return unlink(checkpoint_file.c_str());
+}
+
+void checkpoint::setcounters(int count, int revoked, int expired, int numberofkeys[6][6])
+{
+   checkpoint_count   = count;
+   checkpoint_revoked = revoked;
+   checkpoint_expired = expired;
+   for ( int i=0; i<6; i++)
+      for ( int j=0; j<6; j++)
+         checkpoint_numberofkeys[i][j] = numberofkeys[i][j];
+}
+
+void checkpoint::getcounters(int& count, int& revoked, int& expired, int numberofkeys[6][6])
+{
+   count   = checkpoint_count;
+   revoked = checkpoint_revoked;
+   expired = checkpoint_expired;
+   for ( int i=0; i<6; i++)
+      for ( int j=0; j<6; j++)
+         numberofkeys[i][j] = checkpoint_numberofkeys[i][j];
+}
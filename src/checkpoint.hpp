@@ -0,0 +1,56 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <vector>
+#include <string>
+using namespace std;
+
+#ifndef _checkpoint_hpp_
+#define _checkpoint_hpp_
+
+/*
+State of an interrupted run, so it can be resumed.
+Keys are listed in the order they are stored in the keyring, so the
+fingerprint of the last key which was processed and kept marks where to
+continue. Keys which were selected but maybe not yet deleted are stored as
+pending, together with all counters up to the cursor.
+*/
+class checkpoint{
+
+  public:
+    checkpoint(string file);
+    int load();
+    int save();
+    int remove();
+    void setcounters(int count, int revoked, int expired, int numberofkeys[6][6]);
+    void getcounters(int& count, int& revoked, int& expired, int numberofkeys[6][6]);
+
+    string cursor;	// fingerprint of the last processed key
+    bool   done;	// listing is complete, only pending keys are left
+    vector<string> pending;	// fingerprints of keys to delete
+
+  private:
+    string checkpoint_file;
+    int    checkpoint_count;
+    int    checkpoint_revoked;
+    int    checkpoint_expired;
+    int    checkpoint_numberofkeys[6][6];
+};
+
+#endif
@@ -0,0 +1,411 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <libintl.h>
+
+#include "colonlister.hpp"
+
+#define _(Text) gettext(Text) // _ as short version of gettext
+
+using namespace std;
+
+static const size_t chunksize = 1 << 20;	// bytes of the listing per chunk
+static const size_t readsize  = 1 << 18;	// bytes per read()
+static const int    pipesize  = 1 << 20;	// buffer of the pipe from gpg
+static const size_t maxfields = 12;	// fields of a record we look at
+
+
+colonlister::colonlister()
+: lister_fd(-1), lister_pid(0), lister_current(NULL), lister_pos(0), lister_maxqueued(0),
+  lister_eof(false), lister_stop(false), lister_failed(false), lister_timedout(false)
+  {}
+
+colonlister::~colonlister()
+{
+   finish();
+}
+
+/*
+Run gpg and list its keys
+*/
+int colonlister::start(string gpg, string homedir, bool checktrustdb)
+{
+   int fds[2];
+   if ( pipe(fds) != 0 ) {
+      cerr << _("Can't start ") << gpg << endl;
+      return 1;
+   }
+#ifdef F_SETPIPE_SZ
+   fcntl(fds[0], F_SETPIPE_SZ, pipesize);
+#endif
+   vector<const char*> args;
+   args.push_back(gpg.c_str());
+   args.push_back("--batch");
+   args.push_back("--no-tty");
+   args.push_back("--with-colons");
+   args.push_back("--fixed-list-mode");
+   if ( homedir != "" ) {
+      args.push_back("--homedir");
+      args.push_back(homedir.c_str());
+   }
+   if ( !checktrustdb )
+      args.push_back("--no-auto-check-trustdb");
+   args.push_back("--list-keys");
+   args.push_back(NULL);
+
+   lister_pid = fork();
+   if ( lister_pid < 0 ) {
+      lister_pid = 0;
+      close(fds[0]);
+      close(fds[1]);
+      cerr << _("Can't start ") << gpg << endl;
+      return 1;
+   }
+   if ( lister_pid == 0 ) {
+      dup2(fds[1], STDOUT_FILENO);
+      close(fds[0]);
+      close(fds[1]);
+      execv(gpg.c_str(), (char* const*) &args[0]);
+      _exit(127);
+   }
+   close(fds[1]);
+   return startfd(fds[0]);
+}
+
+/*
+Parse the listing which can be read from 'fd', the lister closes it
+*/
+int colonlister::startfd(int fd)
+{
+   lister_fd = fd;
+   unsigned int threads = thread::hardware_concurrency();
+   if ( threads > 8 )
+      threads = 8;
+   if ( threads > 1 )
+      threads--;	// one for reading
+   if ( threads < 1 )
+      threads = 1;
+   lister_maxqueued = 2 * threads + 2;
+   lister_lastread  = chrono::steady_clock::now();
+   lister_reader = thread(&colonlister::read, this);
+   for ( unsigned int i = 0; i < threads; i++ )
+      lister_workers.push_back(thread(&colonlister::work, this));
+   return 0;
+}
+
+/*
+The next key of the listing, false at the end or if gpg wrote nothing for
+'deadline' ms (0 for no limit), see timedout()
+*/
+bool colonlister::next(keyrecord& record, long deadline)
+{
+   while ( !lister_current || lister_pos >= lister_current->keys.size() ) {
+      unique_lock<mutex> lock(lister_lock);
+      if ( lister_current ) {
+         delete lister_current;
+         lister_current = NULL;
+         lister_changed.notify_all();	// room for the reader
+      }
+      // gpg may have waited for us, so the deadline starts now at the earliest
+      chrono::steady_clock::time_point waiting = chrono::steady_clock::now();
+      while ( !(!lister_queue.empty() && lister_queue.front()->parsed)
+              && !(lister_eof && lister_queue.empty()) ) {
+         if ( deadline <= 0 ) {
+            lister_changed.wait(lock);
+            continue;
+         }
+         chrono::steady_clock::time_point expires = max(lister_lastread, waiting)
+                                                    + chrono::milliseconds(deadline);
+         if ( lister_changed.wait_until(lock, expires) == cv_status::timeout
+              && chrono::steady_clock::now() >= max(lister_lastread, waiting)
+                                                 + chrono::milliseconds(deadline) ) {
+            lister_timedout = true;
+            return false;
+         }
+      }
+      if ( lister_queue.empty() )
+         return false;
+      lister_current = lister_queue.front();
+      lister_queue.pop_front();
+      lister_pos = 0;
+   }
+   // the chunk is thrown away after this anyway
+   swap(record, lister_current->keys[lister_pos++]);
+   return true;
+}
+
+/*
+The listing ended because gpg got stuck
+*/
+bool colonlister::timedout() const
+{
+   return lister_timedout;
+}
+
+/*
+Wait for the threads and gpg, returns 0 if the whole listing was read and
+gpg succeeded
+*/
+int colonlister::finish()
+{
+   if ( lister_fd < 0 )
+      return 0;
+   bool complete;
+   {
+      unique_lock<mutex> lock(lister_lock);
+      complete = lister_eof && lister_queue.empty() && !lister_failed;
+      if ( !complete ) {
+         lister_stop = true;
+         lister_changed.notify_all();
+      }
+   }
+   if ( !complete && lister_pid > 0 )
+      kill(lister_pid, SIGTERM);	// the reader may be blocked in read()
+   if ( lister_reader.joinable() )
+      lister_reader.join();
+   for ( vector<thread>::size_type i = 0; i < lister_workers.size(); i++ )
+      lister_workers[i].join();
+   lister_workers.clear();
+   delete lister_current;
+   lister_current = NULL;
+   for ( deque<chunk*>::size_type i = 0; i < lister_queue.size(); i++ )
+      delete lister_queue[i];
+   lister_queue.clear();
+   close(lister_fd);
+   lister_fd = -1;
+
+   int status = 0;
+   if ( lister_pid > 0 ) {
+      while ( waitpid(lister_pid, &status, 0) < 0 && errno == EINTR )
+         ;
+      lister_pid = 0;
+   }
+   if ( !complete || !WIFEXITED(status) || WEXITSTATUS(status) != 0 ) {
+      if ( complete )
+         cerr << _("gpg failed to list the keys") << endl;
+      return 1;
+   }
+   return 0;
+}
+
+/*
+Reader thread: cut the listing into chunks at the beginning of a key
+*/
+void colonlister::read()
+{
+   string pending;
+   bool eof = false;
+   while ( !eof ) {
+      size_t old = pending.size();
+      pending.resize(old + readsize);
+      ssize_t got = ::read(lister_fd, &pending[old], readsize);
+      if ( got < 0 && errno == EINTR ) {
+         pending.resize(old);
+         continue;
+      }
+      if ( got < 0 ) {
+         lock_guard<mutex> lock(lister_lock);
+         lister_failed = true;
+      }
+      pending.resize(old + (got > 0 ? got : 0));
+      eof = got <= 0;
+      {
+         lock_guard<mutex> lock(lister_lock);
+         lister_lastread = chrono::steady_clock::now();
+      }
+
+      size_t cut = pending.size();
+      if ( !eof ) {
+         if ( pending.size() < chunksize )
+            continue;
+         cut = pending.rfind("\npub:");
+         if ( cut == string::npos || cut == 0 )
+            continue;	// a huge key, read on
+         cut++;
+      }
+      chunk* piece = new chunk;
+      piece->text.assign(pending, 0, cut);
+      piece->taken = piece->parsed = false;
+      pending.erase(0, cut);
+
+      unique_lock<mutex> lock(lister_lock);
+      while ( lister_queue.size() >= lister_maxqueued && !lister_stop )
+         lister_changed.wait(lock);
+      if ( lister_stop ) {
+         delete piece;
+         break;
+      }
+      lister_queue.push_back(piece);
+      lister_changed.notify_all();
+   }
+   lock_guard<mutex> lock(lister_lock);
+   lister_eof = true;
+   lister_changed.notify_all();
+}
+
+/*
+Worker thread: parse the chunks in the queue
+*/
+void colonlister::work()
+{
+   unique_lock<mutex> lock(lister_lock);
+   while ( true ) {
+      chunk* piece = NULL;
+      for ( deque<chunk*>::size_type i = 0; i < lister_queue.size() && !piece; i++ )
+         if ( !lister_queue[i]->taken )
+            piece = lister_queue[i];
+      if ( !piece ) {
+         if ( lister_eof || lister_stop )
+            return;
+         lister_changed.wait(lock);
+         continue;
+      }
+      piece->taken = true;
+      lock.unlock();
+      parse(piece->text.data(), piece->text.data() + piece->text.size(), piece->keys);
+      string().swap(piece->text);
+      lock.lock();
+      piece->parsed = true;
+      lister_changed.notify_all();
+   }
+}
+
+/*
+Undo the escaping of gpg (\xHH) in a field
+*/
+static string unescape(const char* begin, const char* end)
+{
+   if ( !memchr(begin, '\\', end - begin) )
+      return string(begin, end);
+   string text;
+   text.reserve(end - begin);
+   for ( const char* p = begin; p < end; p++ ) {
+      if ( *p == '\\' && end - p >= 4 && p[1] == 'x' ) {
+         char hex[3] = { p[2], p[3], 0 };
+         text += (char) strtol(hex, NULL, 16);
+         p += 3;
+      }
+      else
+         text += *p;
+   }
+   return text;
+}
+
+/*
+The mail address of a user-id, as gpgme finds it: in angle brackets or
+the whole user-id if it is only an address
+*/
+static string email(const string& uid)
+{
+   string::size_type open = uid.rfind('<');
+   if ( open != string::npos ) {
+      string::size_type close = uid.find('>', open);
+      if ( close != string::npos )
+         return uid.substr(open + 1, close - open - 1);
+   }
+   if ( uid.find('@') != string::npos && uid.find(' ') == string::npos )
+      return uid;
+   return "";
+}
+
+/*
+gpg's validity letters, see doc/DETAILS of gnupg, as gpgme_validity_t
+*/
+static int validity(char letter)
+{
+   switch ( letter ) {
+      case 'q': return 1;
+      case 'n': return 2;
+      case 'm': return 3;
+      case 'f': return 4;
+      case 'u': return 5;
+      default:  return 0;
+   }
+}
+
+/*
+Parse whole keys of the listing in [begin, end) and append them to 'keys'
+*/
+void colonlister::parse(const char* begin, const char* end, vector<keyrecord>& keys)
+{
+   const char* field[maxfields + 1];	// field[i] is the start of field i+1
+   keyrecord* key = NULL;
+   bool havefpr = false;
+   keys.reserve(keys.size() + (end - begin) / 256);	// a key takes a few hundred bytes
+   for ( const char* line = begin; line < end; ) {
+      const char* eol = (const char*) memchr(line, '\n', end - line);
+      if ( !eol )
+         eol = end;
+      // split the line at the colons, field i+1 is [field[i], field[i+1]-1)
+      size_t fields = 0;
+      const char* p = line;
+      while ( fields < maxfields ) {
+         field[fields++] = p;
+         const char* colon = (const char*) memchr(p, ':', eol - p);
+         if ( !colon ) {
+            p = eol + 1;
+            break;
+         }
+         p = colon + 1;
+      }
+      field[fields] = p;
+      if ( fields >= 10 && eol - line > 4 && line[3] == ':' ) {
+         if ( !memcmp(line, "pub", 3) ) {
+            keys.push_back(keyrecord());
+            key = &keys.back();
+            havefpr = false;
+            char trust = *field[1];
+            key->revoked     = trust == 'r';
+            key->expired     = trust == 'e';
+            key->disabled    = trust == 'd'
+                               || (fields >= 12 && memchr(field[11], 'D', field[12] - 1 - field[11]));
+            key->invalid     = trust == 'i' || key->disabled;
+            key->secret      = false;
+            key->created     = strtol(field[5], NULL, 10);
+            key->validity    = 0;
+            key->owner_trust = validity(*field[8]);
+            key->keyid.assign(field[4], field[5] - 1);
+         }
+         else if ( key && !havefpr && !memcmp(line, "fpr", 3) ) {
+            key->fpr.assign(field[9], field[10] - 1);
+            havefpr = true;
+         }
+         else if ( key && !memcmp(line, "uid", 3) ) {
+            if ( key->uids.empty() )
+               key->validity = validity(*field[1]);
+            key->uids.push_back(unescape(field[9], field[10] - 1));
+            string address = email(key->uids.back());
+            if ( address != "" ) {
+               key->emails.push_back(address);
+               key->emailvalidity.push_back(validity(*field[1]));
+            }
+         }
+      }
+      line = eol + 1;
+   }
+}
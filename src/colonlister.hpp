@@ -0,0 +1,83 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <sys/types.h>
+#include "keyrecord.hpp"
+using namespace std;
+
+#ifndef _colonlister_hpp_
+#define _colonlister_hpp_
+
+/*
+Lists the keys with gpg --with-colons instead of gpgme.
+One thread reads the output of gpg and cuts it into chunks of whole keys,
+several threads parse the chunks into keyrecords; next() returns them in
+the order of the listing. No gpgme_key_t is built for a key.
+*/
+class colonlister{
+
+  public:
+    colonlister();
+    ~colonlister();
+    int start(string gpg, string homedir, bool checktrustdb);
+    int startfd(int fd);
+    bool next(keyrecord&, long deadline = 0);
+    bool timedout() const;
+    int finish();
+
+    static void parse(const char* begin, const char* end, vector<keyrecord>& keys);
+
+  private:
+    // A piece of the listing, beginning with a 'pub' record
+    struct chunk {
+       string text;
+       vector<keyrecord> keys;
+       bool taken;	// a worker parses it
+       bool parsed;
+    };
+
+    void read();
+    void work();
+    void stop();
+
+    int             lister_fd;	// output of gpg
+    pid_t           lister_pid;	// gpg, 0 if reading from a given fd
+    deque<chunk*>   lister_queue;	// chunks in the order of the listing
+    chunk*          lister_current;	// chunk next() takes the keys from
+    vector<keyrecord>::size_type lister_pos;
+    unsigned int    lister_maxqueued;	// chunks read ahead, set before the threads start
+    bool            lister_eof;	// everything read
+    bool            lister_stop;	// finish() before the end
+    bool            lister_failed;	// reading failed
+    bool            lister_timedout;	// gpg wrote nothing for longer than the deadline
+    chrono::steady_clock::time_point lister_lastread;	// when gpg last wrote something
+    mutex           lister_lock;
+    condition_variable lister_changed;
+    thread          lister_reader;
+    vector<thread>  lister_workers;
+};
+
+#endif
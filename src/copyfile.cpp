@@ -37,8 +37,9 @@ using namespace std;
 Will copy a <home>/dir/filename to destination/filename 
 equivalent to `cp ~/$dir/$filename $destination/filename` on unix
 destination must already exist
+the size of the file is added to 'bytes'
 */
-int copyfile(string dir, string filename, string destination, bool yes)
+int copyfile(string dir, string filename, string destination, bool yes, long long& bytes)
 {
    string full_filename;
    string full_destination;
@@ -104,5 +105,6 @@ int copyfile(string dir, string filename, string destination, bool yes)
    ifstream ifs(full_filename.c_str(), ios::binary);
    ofstream ofs(full_destination.c_str(), ios::binary);
    ofs << ifs.rdbuf();
+   bytes += inFileInfo.st_size;
    return 0;
 } // end 'copyfile'
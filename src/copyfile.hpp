@@ -20,5 +20,5 @@
 #include <string>
 using namespace std;
 
-int copyfile(string dir, string filename, string destination, bool yes);
+int copyfile(string dir, string filename, string destination, bool yes, long long& bytes);
 
@@ -0,0 +1,86 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "emailindex.hpp"
+
+using namespace std;
+
+
+emailindex::emailindex(int minvalidity)
+: index_minvalidity(minvalidity)
+  {}
+
+/*
+Lowercase and strip surrounding white-space
+*/
+string emailindex::normalise(const string& email)
+{
+   string::size_type begin = email.find_first_not_of(" \t<");
+   string::size_type end   = email.find_last_not_of(" \t>");
+   if ( begin == string::npos )
+      return "";
+   string s = email.substr(begin, end - begin + 1);
+   for ( string::size_type i = 0; i < s.length(); i++ )
+      if ( s[i] >= 'A' && s[i] <= 'Z' )
+         s[i] += 'a' - 'A';
+   return s;
+}
+
+/*
+Record the key for every address whose user-id is valid enough, only valid
+keys can supersede others
+*/
+void emailindex::add(const keyrecord& key)
+{
+   if ( key.revoked || key.expired || key.invalid || key.disabled )
+      return;
+   for ( vector<string>::size_type i = 0; i < key.emails.size(); i++ ) {
+      int validity = i < key.emailvalidity.size() ? key.emailvalidity[i] : 0;
+      if ( validity < index_minvalidity )
+         continue;
+      string email = normalise(key.emails[i]);
+      if ( email == "" )
+         continue;
+      uint32_t& created = index_newest[email];	// 0 if new
+      if ( created < (uint32_t) key.created )
+         created = key.created;
+   }
+}
+
+/*
+Test if there is a valid key for one of the addresses of 'key' which is
+strictly newer than 'key'
+*/
+bool emailindex::superseded(const keyrecord& key) const
+{
+   for ( vector<string>::size_type i = 0; i < key.emails.size(); i++ ) {
+      unordered_map<string, uint32_t>::const_iterator it = index_newest.find(normalise(key.emails[i]));
+      if ( it != index_newest.end() && it->second > (uint32_t) key.created )
+         return true;
+   }
+   return false;
+}
+
+/*
+Number of different addresses
+*/
+unsigned int emailindex::size() const
+{
+   return index_newest.size();
+}
@@ -0,0 +1,54 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <stdint.h>
+#include "keyrecord.hpp"
+using namespace std;
+
+#ifndef _emailindex_hpp_
+#define _emailindex_hpp_
+
+/*
+Index from (normalised) mail address to the newest valid key using it.
+A key is valid for an address if it is usable (not revoked, expired, invalid
+or disabled) and the user-id with the address has at least 'minvalidity'
+(gpgme_validity_t, marginal by default), so a forged user-id of an unchecked
+key can not supersede the real key.
+Every address is stored only once; per address we only keep the creation
+time of its newest valid key, which is all needed to find superseded keys.
+*/
+class emailindex{
+
+  public:
+    emailindex(int minvalidity = 3);
+    void add(const keyrecord&);
+    bool superseded(const keyrecord&) const;
+    unsigned int size() const;
+
+  private:
+    static string normalise(const string&);
+
+    int index_minvalidity;
+    unordered_map<string, uint32_t> index_newest;	// address -> creation of its newest valid key
+};
+
+#endif
@@ -20,11 +20,27 @@
 #include <iostream>
 #include <iomanip>
 #include <unistd.h>
+#include <stdlib.h>
+#include <pwd.h>
 #include <libintl.h>
 
 #include "vectorutil.hpp"
 #include "stringutil.hpp"
 #include "copyfile.hpp"
+#include "keyfile.hpp"
+#include "keywriter.hpp"
+#include "checkpoint.hpp"
+#include "secretkeys.hpp"
+#include "progress.hpp"
+#include "metrics.hpp"
+#include "history.hpp"
+#include "throttle.hpp"
+#include "watchdog.hpp"
+#include "snapshot.hpp"
+#include "trustdb.hpp"
+#include "keybox.hpp"
+#include "prune.hpp"
+#include "colonlister.hpp"
 #include "auditor.hpp"
 #include "parsearguments.hpp"
 #include "userinteraction.hpp"
@@ -36,15 +52,53 @@
 
 using namespace std;
 
+// Number of keys between two checkpoints
+static const int checkpoint_interval = 1000;
+// How often the listing may time out at the same key before it is skipped
+static const int max_stalls = 2;
+// Fingerprints per listing when the keys are listed by fingerprint
+static const vector<string>::size_type perbatch = 1000;
 
 // definitions of functions, implementations see below
-int backup(bool yes, string destination);
-int remove_key(gpgme_ctx_t ctx, gpgme_key_t key, bool quiet);
+int backup(bool yes, string destination, long long& bytes);
+int remove_key(gpgme_key_t key, watchdog& guard);
+void report_removal(int status, bool quiet);
+int handle_match(watchdog& guard, gpgme_key_t key, const keyrecord& record,
+                 const options& opts, keywriter& writer);
+int flush_batch(watchdog& guard, vector<gpgme_key_t>& batch, const options& opts,
+                const secretkeys& secrets, keywriter& writer);
+int resume_pending(gpgme_ctx_t& ctx, watchdog& guard, const vector<string>& pending,
+                   const options& opts, const secretkeys& secrets, keywriter& writer);
+gpgme_error_t get_key(gpgme_ctx_t& ctx, watchdog& guard, const options& opts,
+                      const string& fpr, gpgme_key_t& key);
+gpgme_error_t new_context(gpgme_ctx_t& ctx, bool checktrustdb = true);
+int list_snapshot(gpgme_ctx_t ctx, vector<snapshotentry>& entries);
+int diff_keyrings(gpgme_ctx_t ctx, const options& opts);
+int time_listing(const options& opts, double& seconds);
+int compact_keyring(const string& homedir, const options& opts);
 void print_key(gpgme_key_t key);
+string gnupg_home(gpgme_engine_info_t enginfo);
+void fill_record(gpgme_key_t key, keyrecord& record, const secretkeys& secrets);
+gpgme_error_t start_listing(gpgme_ctx_t ctx, keyfile& dump, const options& opts);
+gpgme_error_t list_batch(gpgme_ctx_t ctx, const vector<string>& fprs,
+                         vector<string>::size_type pos, vector<string>::size_type& end);
+int build_index(gpgme_ctx_t ctx, keyfile& dump, const options& opts,
+                const secretkeys& secrets, emailindex& index);
+gpgme_error_t list_colons(gpgme_ctx_t& ctx, gpgme_engine_info_t enginfo, const options& opts,
+                          auditor& keyauditor, const trustdb& trust, const secretkeys& secrets,
+                          watchdog& guard, keywriter& writer, int& count, long& listed,
+                          string& lastkept, int& revokedkeys, int& expiredkeys,
+                          int numberofkeys[6][6]);
+int what_if(gpgme_ctx_t ctx, gpgme_engine_info_t enginfo, keyfile& dump, const options& opts,
+            vector<auditor>& rules, const vector<string>& names, const trustdb& trust,
+            const secretkeys& secrets);
+int sample_statistics(gpgme_ctx_t ctx, const string& homedir, const options& opts);
 
 
 int main(int argc, char *argv[]) {
    int count = 0; // count number of key's deleted
+   struct timespec started;
+   clock_gettime(CLOCK_MONOTONIC, &started);
 
    /* i18n */
    setlocale( LC_ALL, "" );
@@ -54,32 +108,42 @@ int main(int argc, char *argv[]) {
    /* Parse arguments */
    // The auditor contains all the options an logic about deciding where to delete a key or not
    auditor keyauditor;
-   bool dobackup       = false;
-   string destination  = "";
-   bool statistics     = false; // Print out statistics
-   bool onlystatistics = false; // Do nothing but statistics, implies statistics==true
-   bool quiet    = false;  // For quiet-mode
-   bool dry      = false;  // For dry-mode
-   bool yes      = false;  // For 'yes-mode'
+   options opts;
    
    // Parse the arguments
-   int parsestat = parsearguments(argc, argv, keyauditor, dobackup, destination,
-                                  statistics, onlystatistics, quiet, dry, yes);
+   int parsestat = parsearguments(argc, argv, keyauditor, opts);
 
    if ( parsestat == -1) // option -h is given, exit
       return 0;
    else if ( parsestat != 0 ) // an error occurred, exit
       return parsestat;
 
+   // Rule sets to try, each with its own auditor
+   vector<auditor> rules;
+   vector<string> rulenames;
+   if ( opts.mode == MODE_WHATIF && parserules(opts.whatif, rules, rulenames) )
+      return 1;
+
+   // Only reads the history, no need for gpg
+   if ( opts.mode == MODE_TREND )
+      return history_trend(opts.history, opts.since, opts.until) ? 21 : 0;
+
+   /* Stay out of the way of other users of the keyring */
+   if ( opts.lowimpact )
+      throttle_lowpriority();
+   if ( opts.maxrate > 0 )
+      throttle_start(opts.maxrate);
+
    /* Make a backup */
-   if ( dobackup ) {
-      if ( backup(yes, destination) )
+   long long backupbytes = 0;
+   if ( opts.dobackup ) {
+      if ( backup(opts.yes, opts.destination, backupbytes) )
          return 3;
    }
    
    // Security-question
-   if (!yes && !onlystatistics )
-      if ( !ask_user(keyauditor.generatequestion()) ) {
+   if (!opts.yes && !opts.onlystatistics && opts.fromfile == "" && opts.mode == MODE_CLEANUP )
+      if ( !ask_user(keyauditor.generatequestion(opts.prune)) ) {
          cout << _("By") << endl;
          return 0;
       }
@@ -92,29 +156,42 @@ int main(int argc, char *argv[]) {
    gpgme_engine_info_t enginfo;
    
    p = (char *) gpgme_check_version(NULL);
-   if (!quiet)
+   if (!opts.quiet)
       printf(_("GPG-Version=%s\n"), p);
 
    /* check for OpenPGP support */
    err = gpgme_engine_check_version(GPGME_PROTOCOL_OpenPGP);
    if (err != GPG_ERR_NO_ERROR)       return 11;
    p = (char *) gpgme_get_protocol_name(GPGME_PROTOCOL_OpenPGP);
-   if (!quiet)
+   if (!opts.quiet)
       printf(_("Protocol name: %s\n"), p);
 
    /* get engine information */
    err = gpgme_get_engine_info(&enginfo);
    if (err != GPG_ERR_NO_ERROR)       return 12;
-   if (!quiet)
+   if (!opts.quiet)
       printf(_("file=%s, home=%s\n\n"), enginfo->file_name, enginfo->home_dir);
 
    /* create our own context */
-   err = gpgme_new(&ctx);
+   err = new_context(ctx, opts.trustdbcheck);
    if (err != GPG_ERR_NO_ERROR)       return 13;
 
-   /* set protocol to use in our context */
-   err = gpgme_set_protocol(ctx, GPGME_PROTOCOL_OpenPGP);
-   if (err != GPG_ERR_NO_ERROR)       return 14;
+   /* Modes which only look at the keyring */
+   if ( opts.mode == MODE_SNAPSHOT ) {
+      vector<snapshotentry> entries;
+      if ( list_snapshot(ctx, entries) )
+         return 10;
+      return snapshot_write(opts.snapshot, entries) ? 18 : 0;
+   }
+   if ( opts.mode == MODE_DIFF )
+      return diff_keyrings(ctx, opts);
+   string homedir = gnupg_home(enginfo);
+   if ( opts.mode == MODE_COMPACT ) {
+      gpgme_release (ctx);
+      return compact_keyring(homedir, opts);
+   }
+   if ( opts.mode == MODE_SAMPLE )
+      return sample_statistics(ctx, homedir, opts);
 
    // For counting the number of keys
    int revokedkeys = 0;
@@ -124,56 +201,323 @@ int main(int argc, char *argv[]) {
       for ( int j=0; j<6; j++)
          numberofkeys[i][j]=0;
    
+   // keys of an exported dump, they never enter the keyring
+   keyfile dump;
+   if ( opts.fromfile != "" && dump.open(opts.fromfile) )
+      return 2;
+
+   // Secret keys are never deleted, know them in advance
+   secretkeys secrets;
+   if ( !opts.onlystatistics && opts.fromfile == "" ) {
+      err = secrets.load(ctx);
+      if (err) {
+         cerr << _("can not list keys: ") << gpgme_strerror (err) << endl;
+         return 10;
+      }
+   }
+
+   // Some criteria need to know all the other keys first
+   emailindex index;
+   bool needsindex = keyauditor.needsindex();
+   for ( vector<auditor>::size_type i = 0; i < rules.size(); i++ )
+      needsindex = needsindex || rules[i].needsindex();
+   if ( !opts.onlystatistics && needsindex ) {
+      if ( build_index(ctx, dump, opts, secrets, index) )
+         return 10;
+      keyauditor.setindex(&index);
+      for ( vector<auditor>::size_type i = 0; i < rules.size(); i++ )
+         rules[i].setindex(&index);
+   }
+
+   // Trust and validity as cached by gpg
+   trustdb trust;
+   if ( opts.usetrustdb && trust.open(opts.trustdb != "" ? opts.trustdb : homedir + "/trustdb.gpg") )
+      return 19;
+
+   if ( opts.mode == MODE_WHATIF ) {
+      progress_start(opts.progress, opts.statusfd,
+                     opts.fromfile == "" ? progress_readcount(homedir) : 0);
+      int status = what_if(ctx, enginfo, dump, opts, rules, rulenames, trust, secrets);
+      progress_finish();
+      gpgme_release (ctx);
+      return status;
+   }
+
+   // State of an interrupted run
+   checkpoint state(opts.checkpoint);
+   bool checkpointing = opts.checkpoint != "";
+   bool batching = checkpointing && !opts.dry; // delete keys only at checkpoints
+   bool skipping = false; // skip keys up to 'skipto'
+   string skipto;
+   keyrecord record;
+   keywriter writer(STDOUT_FILENO, opts.format);
+   watchdog guard(opts.deadline); // cancels operations which take too long
+   if ( opts.resume ) {
+      if ( state.load() )
+         return 16;
+      state.getcounters(count, revokedkeys, expiredkeys, numberofkeys);
+      skipto   = state.cursor;
+      skipping = skipto != "" && !state.done;
+      count += resume_pending(ctx, guard, state.pending, opts, secrets, writer);
+   }
+
+   progress_start(opts.progress, opts.statusfd,
+                  opts.fromfile == "" ? progress_readcount(homedir) : 0);
+
    /* Now get all Keys */
-   if (!err)
+   long listed = 0; // keys listed
+   string lastkept;	// last processed key which is still in the keyring
+   long stalledat = -1;	int stalls = 0;	// where (keys listed) and how often the listing timed out
+   bool stuck = false;	// the listing timed out and the keys behind can't be found
+   // After the listing got stuck: the keys behind, listed by fingerprint
+   bool byfingerprint = false;
+   vector<string> rest;
+   vector<string>::size_type restpos = 0, restend = 0;	// next key and end of the listing
+   if ( opts.resume && state.done )
+      err = gpg_error(GPG_ERR_EOF);
+   else if ( opts.colons ) { // all the work is done there, err is EOF afterwards
+      err = list_colons(ctx, enginfo, opts, keyauditor, trust, secrets, guard, writer,
+                        count, listed, lastkept, revokedkeys, expiredkeys, numberofkeys);
+      if ( gpg_err_code (err) == GPG_ERR_TIMEOUT ) {
+         cerr << _("Listing keys timed out after key ") << lastkept
+              << _(", listing the rest by fingerprint") << endl;
+         byfingerprint = true;
+         stuck = keybox_behind(homedir + "/pubring.kbx", lastkept, rest) != 0;
+         err = stuck ? gpg_error(GPG_ERR_TIMEOUT) : list_batch(ctx, rest, restpos, restend);
+      }
+   }
+   else
+      err = start_listing(ctx, dump, opts);
+   vector<gpgme_key_t> batch; // selected keys, deleted at the next checkpoint
+   int sincecheckpoint = 0;
+   while (!err)
    {
-      err = gpgme_op_keylist_start (ctx, NULL, 0);
-      while (!err)
-      {
-         bool fail = true;
-         err = gpgme_op_keylist_next (ctx, &key);
-         if (err) {
+      int status = 1; // key not deleted, see remove_key
+      guard.arm(ctx);
+      err = gpgme_op_keylist_next (ctx, &key);
+      if ( guard.disarm() ) {
+         // timed out, maybe only after the key was listed: it's listed again
+         if (!err)
             gpgme_key_release (key);
-            break;
+         if ( stalledat != listed ) {
+            stalledat = listed;
+            stalls    = 0;
          }
-
-         if ( !key->uids )
+         count += flush_batch(guard, batch, opts, secrets, writer);
+         gpgme_release (ctx);
+         err = new_context(ctx, opts.trustdbcheck);
+         if (err)
             break;
-            
-         if ( key->uids->validity > 6 || key->owner_trust > 6 )
-            cerr << _("Warning: Some keys have validity  or trust biger than 5.") << endl;
+         if ( ++stalls > max_stalls ) {
+            // always the same key: skip it, list the keys behind it by fingerprint
+            if ( !byfingerprint ) {
+               if ( opts.fromfile != ""
+                    || keybox_behind(homedir + "/pubring.kbx", lastkept, rest) ) {
+                  stuck = true;
+                  err   = gpg_error(GPG_ERR_TIMEOUT);
+                  break;
+               }
+               byfingerprint = true;
+               skipping      = false;
+               restpos       = 0;
+            }
+            if ( restpos < rest.size() )
+               cerr << _("Skipped key, listing it timed out: ") << rest[restpos++] << endl;
+            stalledat = -1;
+         }
          else
-            numberofkeys[key->uids->validity][key->owner_trust]++;
-         if ( key->revoked )
-            revokedkeys++;
-         if ( key->expired )
-            expiredkeys++;
-
-         if ( !onlystatistics )
-            // Test if keys should be deleted
-            if ( keyauditor.test(key->revoked, key->expired, key->uids->validity,
-                                 key->owner_trust, key->subkeys->keyid) ) {
-               if (!quiet) print_key(key);
-               if (!dry) fail = remove_key(ctx, key, quiet);
+            cerr << _("Listing keys timed out after key ") << lastkept
+                 << _(", restarting") << endl;
+         if ( byfingerprint )
+            err = list_batch(ctx, rest, restpos, restend);
+         else {
+            // start again, behind the last key which is still there
+            err      = start_listing(ctx, dump, opts);
+            skipto   = lastkept;
+            skipping = skipto != "";
+         }
+         continue;
+      }
+      if ( byfingerprint && gpg_err_code (err) == GPG_ERR_EOF && restend < rest.size() ) {
+         restpos = restend;
+         err = list_batch(ctx, rest, restpos, restend);
+         continue;
+      }
+      if (err)
+         break;
+
+      if ( !key->uids )
+         break;
+      if ( byfingerprint && key->subkeys->fpr )
+         for ( vector<string>::size_type i = restpos; i < restend; i++ )
+            if ( rest[i] == key->subkeys->fpr ) {
+               restpos = i + 1;
+               break;
             }
 
+      // already processed before the run was interrupted
+      if ( skipping ) {
+         if ( key->subkeys->fpr && skipto == key->subkeys->fpr )
+            skipping = false;
          gpgme_key_release (key);
-         if ( !fail )
-            count++;
-      } // end while
-      gpgme_release (ctx);
-      
-      if(statistics) {
-         printstatistics(revokedkeys, expiredkeys, numberofkeys);
+         continue;
+      }
+      listed++;
+      progress_scanned();
+         
+      int validity = key->uids->validity, owner_trust = key->owner_trust;
+      if ( opts.usetrustdb && key->subkeys->fpr )
+         trust.lookup(key->subkeys->fpr, validity, owner_trust);
+      if ( validity > 6 || owner_trust > 6 )
+         cerr << _("Warning: Some keys have validity  or trust biger than 5.") << endl;
+      else
+         numberofkeys[validity][owner_trust]++;
+      if ( key->revoked )
+         revokedkeys++;
+      if ( key->expired )
+         expiredkeys++;
+
+      // Test if keys should be deleted
+      bool selected = false;
+      if ( !opts.onlystatistics ) {
+         fill_record(key, record, secrets);
+         record.validity    = validity;
+         record.owner_trust = owner_trust;
+         if ( keyauditor.test(record) ) {
+            selected = true;
+            progress_matched();
+            if ( batching && !record.secret ) {
+               gpgme_key_ref (key);
+               batch.push_back(key);
+            }
+            else
+               status = handle_match(guard, key, record, opts, writer);
+         }
+      }
+      if ( status == 0 )
+         count++;
+      if ( key->subkeys->fpr
+           && (opts.prune || !(selected && (status == 0 || (batching && !record.secret)))) )
+         lastkept = key->subkeys->fpr;
+
+      // Checkpoint, the cursor must be a key which stays in the keyring
+      sincecheckpoint++;
+      if ( checkpointing && !(batching && selected) && key->subkeys->fpr
+           && sincecheckpoint >= checkpoint_interval ) {
+         state.cursor = key->subkeys->fpr;
+         state.pending.clear();
+         for ( vector<gpgme_key_t>::size_type i = 0; i < batch.size(); i++ )
+            state.pending.push_back(batch[i]->subkeys->fpr);
+         state.setcounters(count, revokedkeys, expiredkeys, numberofkeys);
+         if ( state.save() )
+            return 16;
+         count += flush_batch(guard, batch, opts, secrets, writer);
+         state.pending.clear();
+         state.setcounters(count, revokedkeys, expiredkeys, numberofkeys);
+         if ( state.save() )
+            return 16;
+         sincecheckpoint = 0;
       }
+
+      gpgme_key_release (key);
+      progress_tick();
+   } // end while
+   progress_finish();
+
+   if ( gpg_err_code (err) == GPG_ERR_EOF && !skipping && checkpointing ) {
+      // delete the rest, then the run is complete
+      state.done = true;
+      state.pending.clear();
+      for ( vector<gpgme_key_t>::size_type i = 0; i < batch.size(); i++ )
+         state.pending.push_back(batch[i]->subkeys->fpr);
+      state.setcounters(count, revokedkeys, expiredkeys, numberofkeys);
+      if ( state.save() )
+         return 16;
+      count += flush_batch(guard, batch, opts, secrets, writer);
+      state.remove();
+   }
+
+   // One more try for keys which timed out
+   if ( gpg_err_code (err) == GPG_ERR_EOF && !guard.cancelled.empty() ) {
+      vector<string> retry = guard.cancelled;
+      guard.cancelled.clear();
+      count += resume_pending(ctx, guard, retry, opts, secrets, writer);
+      for ( vector<string>::size_type i = 0; i < guard.cancelled.size(); i++ )
+         cerr << _("Skipped after timeout: ") << guard.cancelled[i] << endl;
+   }
+   prune_finish();
+   writer.flush();
+   gpgme_release (ctx);
+
+   if ( stuck )
+   {
+      cerr << _("Listing keys timed out after key ") << lastkept << endl;
+      return 10;
    }
    if (gpg_err_code (err) != GPG_ERR_EOF)
    {
       cerr << _("can not list keys: ") << gpgme_strerror (err) << endl;
       return 10;
    }
-   if ( !onlystatistics && !dry )
-      printf(_("Deleted %i key(s).\n"), count);
+   if ( skipping )
+   {
+      cerr << _("The keyring does not match the checkpoint") << endl;
+      return 16;
+   }
+   // Estimate for the next progress display, only written if progress is
+   // shown, so other runs don't write to the gnupg directory
+   if ( opts.fromfile == "" && !opts.resume && (opts.progress || opts.statusfd >= 0) )
+      progress_savecount(homedir, listed - (opts.dry || opts.prune ? 0 : count));
+   if(opts.statistics) {
+      if ( opts.format == FORMAT_HUMAN )
+         printstatistics(revokedkeys, expiredkeys, numberofkeys);
+      else
+         writer.statistics(revokedkeys, expiredkeys, numberofkeys);
+   }
+   if ( opts.metrics != "" ) {
+      runmetrics metrics;
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      metrics.keyring     = opts.fromfile != "" ? opts.fromfile : homedir;
+      metrics.revokedkeys = revokedkeys;
+      metrics.expiredkeys = expiredkeys;
+      for ( int i=0; i<6; i++)
+         for ( int j=0; j<6; j++)
+            metrics.numberofkeys[i][j] = numberofkeys[i][j];
+      metrics.duration    = (now.tv_sec - started.tv_sec) * 1000
+                          + (now.tv_nsec - started.tv_nsec) / 1000000;
+      progress_counts(metrics.deleted, metrics.skipped, metrics.errors);
+      metrics.backupbytes = backupbytes;
+      if ( writemetrics(opts.metrics, metrics) )
+         return 17;
+   }
+   if ( opts.history != "" ) {
+      historyentry entry;
+      entry.time = time(NULL);
+      for ( int i=0; i<6; i++)
+         for ( int j=0; j<6; j++)
+            entry.values[HISTORY_MATRIX + 6*i + j] = numberofkeys[i][j];
+      entry.values[HISTORY_REVOKED] = revokedkeys;
+      entry.values[HISTORY_EXPIRED] = expiredkeys;
+      unsigned long deleted, skipped, failed;
+      progress_counts(deleted, skipped, failed);
+      entry.values[HISTORY_DELETED] = deleted;
+      entry.values[HISTORY_SKIPPED] = skipped;
+      entry.values[HISTORY_FAILED]  = failed;
+      if ( history_append(opts.history, entry) )
+         return 21;
+   }
+   if ( !opts.onlystatistics && !opts.dry && opts.format == FORMAT_HUMAN ) {
+      if ( opts.prune && opts.statistics )
+         printf(_("Pruned %i key(s), %lld bytes saved.\n"), count, prune_saved());
+      else if ( opts.prune )
+         printf(_("Pruned %i key(s).\n"), count);
+      else
+         printf(_("Deleted %i key(s).\n"), count);
+      throttle_report();
+   }
+   if ( opts.compact && !opts.onlystatistics && opts.fromfile == "" )
+      return compact_keyring(homedir, opts);
 } // end 'main'
 
 
@@ -181,7 +525,7 @@ int main(int argc, char *argv[]) {
 /*
 Backup keyring-files to a directory given by the user
 */
-int backup(bool yes, string destination)
+int backup(bool yes, string destination, long long& bytes)
 {
    if ( destination == "" ) {
       cout << _("Where should I put the backup? (Directory must exist) ");
@@ -189,9 +533,9 @@ int backup(bool yes, string destination)
    }
    if ( destination == "" )
       destination="backup/";
-   if ( copyfile("/.gnupg/", "pubring.gpg", destination, yes) )
+   if ( copyfile("/.gnupg/", "pubring.gpg", destination, yes, bytes) )
       return 1;
-   if ( copyfile("/.gnupg/", "pubring.kbx", destination, yes) )
+   if ( copyfile("/.gnupg/", "pubring.kbx", destination, yes, bytes) )
       return 1;
    cout << _("Successfully backuped pubring.gpg and pubring.kbx") << endl;
    return 0;
@@ -221,23 +565,712 @@ void print_key(gpgme_key_t key)
 
 
 /*
-Delete key 'key' from pubring via context 'ctx'
-*/ 
-int remove_key(gpgme_ctx_t ctx, gpgme_key_t key, bool quiet)
+Start listing the keys of the keyring, or of the dump if one is given
+*/
+gpgme_error_t start_listing(gpgme_ctx_t ctx, keyfile& dump, const options& opts)
+{
+   if ( opts.fromfile != "" ) {
+      if ( dump.rewind() )
+         return gpg_error(GPG_ERR_EIO);
+      return gpgme_op_keylist_from_data_start (ctx, dump.data(), 0);
+   }
+   return gpgme_op_keylist_start (ctx, NULL, 0);
+}
+
+/*
+List the keys fprs[pos] up to (not including) 'end', which is set to at most
+'perbatch' keys behind 'pos'; gpg reads the whole keyring for every listing
+*/
+gpgme_error_t list_batch(gpgme_ctx_t ctx, const vector<string>& fprs,
+                         vector<string>::size_type pos, vector<string>::size_type& end)
+{
+   vector<const char*> patterns;
+   for ( end = pos; end < fprs.size() && end < pos + perbatch; end++ )
+      patterns.push_back(fprs[end].c_str());
+   if ( patterns.empty() )
+      return gpg_error(GPG_ERR_EOF);
+   patterns.push_back(NULL);
+   return gpgme_op_keylist_ext_start (ctx, &patterns[0], 0, 0);
+}
+
+
+
+/*
+List fingerprint and last update of all keys, sorted by fingerprint
+*/
+int list_snapshot(gpgme_ctx_t ctx, vector<snapshotentry>& entries)
+{
+   gpgme_key_t key;
+   snapshotentry entry;
+   gpgme_error_t err = gpgme_op_keylist_start (ctx, NULL, 0);
+   while (!err) {
+      err = gpgme_op_keylist_next (ctx, &key);
+      if (err)
+         break;
+      if ( key->subkeys && key->subkeys->fpr ) {
+         entry.fpr = key->subkeys->fpr;
+         entry.last_update = key->last_update;
+         entries.push_back(entry);
+      }
+      gpgme_key_release (key);
+   }
+   if (gpg_err_code (err) != GPG_ERR_EOF) {
+      cerr << _("can not list keys: ") << gpgme_strerror (err) << endl;
+      return 1;
+   }
+   snapshot_sort(entries);
+   return 0;
+}
+
+
+
+/*
+Compare the keyring with a snapshot, two snapshots with each other, or a
+fleet of snapshots with the first one.
+Sketches are compared first, the keys themselves only if they differ; only
+differing keys of the keyring are listed in full.
+returns 0 if everything is equal, 1 if not, >1 on errors
+*/
+int diff_keyrings(gpgme_ctx_t ctx, const options& opts)
+{
+   vector<snapshotreader> snapshots(opts.difffiles.size());
+   for ( vector<string>::size_type i = 0; i < opts.difffiles.size(); i++ )
+      if ( snapshots[i].open(opts.difffiles[i]) )
+         return 18;
+
+   // A fleet: only compare the sketches
+   if ( snapshots.size() > 2 ) {
+      int differ = 0;
+      for ( vector<snapshotreader>::size_type i = 1; i < snapshots.size(); i++ ) {
+         const keysketch& sketch = snapshots[i].sketch();
+         bool equal = sketch.equal(snapshots[0].sketch());
+         printf("%s: %lu %s (~%.0f), %s, %s %.2f\n", opts.difffiles[i].c_str(), sketch.keys(),
+                _("keys"), sketch.estimate(), equal ? _("identical") : _("different"),
+                _("similarity"), sketch.similarity(snapshots[0].sketch()));
+         if ( !equal )
+            differ = 1;
+      }
+      return differ;
+   }
+
+   // Keyring against snapshot or snapshot against snapshot
+   vector<snapshotentry> keyring;
+   keysketch sketch;
+   if ( snapshots.size() == 1 ) {
+      if ( list_snapshot(ctx, keyring) )
+         return 10;
+      for ( vector<snapshotentry>::size_type i = 0; i < keyring.size(); i++ )
+         sketch.add(keyring[i]);
+   }
+   else
+      sketch = snapshots[1].sketch();
+   if ( sketch.equal(snapshots[0].sketch()) ) {
+      cout << _("identical") << endl;
+      return 0;
+   }
+
+   // merge-join of the sorted lists
+   vector<snapshotentry>::size_type pos = 0;
+   snapshotentry old, now;
+   bool haveold = snapshots[0].next(old);
+   bool havenow = snapshots.size() == 1 ? pos < keyring.size() : snapshots[1].next(now);
+   if ( snapshots.size() == 1 && havenow )
+      now = keyring[pos++];
+   vector<string> changed; // keys of the keyring to list in full
+   while ( haveold || havenow ) {
+      int cmp = !haveold ? 1 : !havenow ? -1 : old.fpr.compare(now.fpr);
+      if ( cmp < 0 )
+         printf("- %s\n", old.fpr.c_str());
+      else if ( cmp > 0 ) {
+         printf("+ %s\n", now.fpr.c_str());
+         changed.push_back(now.fpr);
+      }
+      else if ( old.last_update != now.last_update ) {
+         printf("~ %s\n", now.fpr.c_str());
+         changed.push_back(now.fpr);
+      }
+      if ( cmp <= 0 )
+         haveold = snapshots[0].next(old);
+      if ( cmp >= 0 ) {
+         if ( snapshots.size() == 1 ) {
+            havenow = pos < keyring.size();
+            if ( havenow )
+               now = keyring[pos++];
+         }
+         else
+            havenow = snapshots[1].next(now);
+      }
+   }
+
+   if ( snapshots.size() == 1 && !opts.quiet ) {
+      gpgme_key_t key;
+      for ( vector<string>::size_type i = 0; i < changed.size(); i++ )
+         if ( gpgme_get_key (ctx, changed[i].c_str(), &key, 0) == GPG_ERR_NO_ERROR ) {
+            print_key(key);
+            gpgme_key_release (key);
+         }
+   }
+   return 1;
+}
+
+
+
+/*
+The directory gpg keeps its files in
+*/
+string gnupg_home(gpgme_engine_info_t enginfo)
+{
+   if ( enginfo && enginfo->home_dir )
+      return enginfo->home_dir;
+   const char* env = getenv("GNUPGHOME");
+   if ( env && env[0] )
+      return env;
+   struct passwd *pw = getpwuid(getuid());
+   return string(pw->pw_dir) + "/.gnupg";
+}
+
+
+
+/*
+Index the mail addresses of all keys in one listing
+*/
+int build_index(gpgme_ctx_t ctx, keyfile& dump, const options& opts,
+                const secretkeys& secrets, emailindex& index)
+{
+   gpgme_key_t key;
+   keyrecord record;
+   gpgme_error_t err = start_listing(ctx, dump, opts);
+   while (!err) {
+      err = gpgme_op_keylist_next (ctx, &key);
+      if (err)
+         break;
+      if ( key->uids && key->subkeys ) {
+         fill_record(key, record, secrets);
+         index.add(record);
+      }
+      gpgme_key_release (key);
+   }
+   if (gpg_err_code (err) != GPG_ERR_EOF) {
+      cerr << _("can not list keys: ") << gpgme_strerror (err) << endl;
+      return 1;
+   }
+   return 0;
+}
+
+
+
+/*
+Copy the fields the auditor needs from 'key' into 'record'
+*/
+void fill_record(gpgme_key_t key, keyrecord& record, const secretkeys& secrets)
+{
+   record.revoked     = key->revoked;
+   record.expired     = key->expired;
+   record.invalid     = key->invalid || key->disabled;
+   record.disabled    = key->disabled;
+   record.created     = key->subkeys->timestamp;
+   record.validity    = key->uids->validity;
+   record.owner_trust = key->owner_trust;
+   record.keyid       = key->subkeys->keyid;
+   record.fpr         = key->subkeys->fpr ? key->subkeys->fpr : "";
+   record.secret      = secrets.contains(record.fpr);
+   record.uids.clear();
+   record.emails.clear();
+   record.emailvalidity.clear();
+   for ( gpgme_user_id_t uid = key->uids; uid; uid = uid->next ) {
+      if ( uid->uid )
+         record.uids.push_back(uid->uid);
+      if ( uid->email && uid->email[0] ) {
+         record.emails.push_back(uid->email);
+         record.emailvalidity.push_back(uid->revoked || uid->invalid ? 0 : uid->validity);
+      }
+   }
+}
+
+
+
+/*
+Print, delete and report a key selected by the auditor
+returns the status of remove_key
+*/
+int handle_match(watchdog& guard, gpgme_key_t key, const keyrecord& record,
+                 const options& opts, keywriter& writer)
+{
+   int status = 1;
+   if (!opts.quiet) print_key(key);
+   if ( record.secret ) {
+      // gpg would refuse anyway
+      progress_result(status);
+      if ( opts.format == FORMAT_HUMAN )
+         report_removal(status, opts.quiet);
+   }
+   else if ( !opts.dry && opts.prune ) {
+      long long saved;
+      status = prune_key(key, guard, opts.statistics, saved);
+      progress_result(status);
+      if ( opts.format == FORMAT_HUMAN && status == 0 ) {
+         if ( !opts.quiet ) {
+            if ( opts.statistics )
+               cout << "\t=> " << _("pruned key, bytes saved: ") << saved << endl;
+            else
+               cout << "\t=> " << _("pruned key") << endl;
+         }
+      }
+      else if ( opts.format == FORMAT_HUMAN )
+         report_removal(status, opts.quiet);
+   }
+   else if (!opts.dry) {
+      status = remove_key(key, guard);
+      progress_result(status);
+      if ( opts.format == FORMAT_HUMAN )
+         report_removal(status, opts.quiet);
+   }
+   if ( opts.format != FORMAT_HUMAN ) {
+      const char* actions[] = { "deleted", "skipped", "failed", "timeout" };
+      if ( opts.prune )
+         actions[0] = "pruned";
+      writer.write(record, !record.secret && opts.dry ? "matched" : actions[status]);
+   }
+   return status;
+}
+
+
+
+/*
+Delete all keys of the batch, returns the number of deleted keys
+*/
+int flush_batch(watchdog& guard, vector<gpgme_key_t>& batch, const options& opts,
+                const secretkeys& secrets, keywriter& writer)
+{
+   int deleted = 0;
+   keyrecord record;
+   for ( vector<gpgme_key_t>::size_type i = 0; i < batch.size(); i++ ) {
+      fill_record(batch[i], record, secrets);
+      if ( handle_match(guard, batch[i], record, opts, writer) == 0 )
+         deleted++;
+      gpgme_key_unref (batch[i]);
+   }
+   batch.clear();
+   return deleted;
+}
+
+
+
+/*
+Delete the keys which were pending when the run was interrupted (or timed
+out), returns the number of deleted keys
+*/
+int resume_pending(gpgme_ctx_t& ctx, watchdog& guard, const vector<string>& pending,
+                   const options& opts, const secretkeys& secrets, keywriter& writer)
+{
+   int deleted = 0;
+   gpgme_key_t key;
+   keyrecord record;
+   for ( vector<string>::size_type i = 0; i < pending.size(); i++ ) {
+      gpgme_error_t err = get_key(ctx, guard, opts, pending[i], key);
+      if ( gpg_err_code (err) == GPG_ERR_EOF ) {
+         // was already deleted before the interruption
+         progress_result(0);
+         deleted++;
+         continue;
+      }
+      else if ( gpg_err_code (err) == GPG_ERR_CANCELED ) {
+         guard.cancelled.push_back(pending[i]);
+         continue;
+      }
+      else if ( err )
+         continue;
+      fill_record(key, record, secrets);
+      if ( handle_match(guard, key, record, opts, writer) == 0 )
+         deleted++;
+      gpgme_key_release (key);
+   }
+   return deleted;
+}
+
+
+
+/*
+Get the key with the fingerprint 'fpr' like gpgme_get_key, but on 'ctx' so
+'guard' can cancel it. A cancelled context is replaced by a new one.
+returns GPG_ERR_EOF if there is no such key
+*/
+gpgme_error_t get_key(gpgme_ctx_t& ctx, watchdog& guard, const options& opts,
+                      const string& fpr, gpgme_key_t& key)
+{
+   key = NULL;
+   guard.arm(ctx);
+   gpgme_error_t err = gpgme_op_keylist_start (ctx, fpr.c_str(), 0);
+   if (!err)
+      err = gpgme_op_keylist_next (ctx, &key);
+   if (!err)
+      gpgme_op_keylist_end (ctx);
+   if ( guard.disarm() ) {
+      if (!err)
+         gpgme_key_release (key);
+      key = NULL;
+      gpgme_release (ctx);
+      err = new_context(ctx, opts.trustdbcheck);
+      return err ? err : gpg_error(GPG_ERR_CANCELED);
+   }
+   return err;
+}
+
+
+
+/*
+Create a context for OpenPGP, optional without gpg checking the trustdb
+*/
+gpgme_error_t new_context(gpgme_ctx_t& ctx, bool checktrustdb)
 {
    gpgme_error_t err = gpgme_new (&ctx);
+   if (err)
+      return err;
+   err = gpgme_set_protocol(ctx, GPGME_PROTOCOL_OpenPGP);
+   if ( !err && !checktrustdb )
+      err = gpgme_set_ctx_flag(ctx, "no-auto-check-trustdb", "1");
+   return err;
+}
+
+
+
+/*
+Delete key 'key' from pubring, in its own context as the listing goes on
+returns 0 if deleted, 1 for secret keys, which are skipped, 2 on error,
+3 if it took too long and was cancelled
+*/ 
+int remove_key(gpgme_key_t key, watchdog& guard)
+{
+   gpgme_ctx_t ctx;
+   gpgme_error_t err = new_context(ctx);
+   if (err)
+      return 2;
+   // gpg locks the keyring while deleting
+   throttle_wait();
+   struct timespec begin, end;
+   clock_gettime(CLOCK_MONOTONIC, &begin);
+   guard.arm(ctx);
    err = gpgme_op_delete (ctx, key, 0 );
-   if (gpg_err_code (err) == GPG_ERR_CONFLICT ) {
+   bool cancelled = guard.disarm();
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   throttle_gpgtime((end.tv_sec - begin.tv_sec) * 1000000 + (end.tv_nsec - begin.tv_nsec) / 1000);
+   gpgme_release (ctx);
+   if ( cancelled && gpg_err_code (err) == GPG_ERR_CANCELED ) {
+      guard.cancelled.push_back(key->subkeys->fpr);
+      return 3;
+   }
+   else if (gpg_err_code (err) == GPG_ERR_CONFLICT )
+      return 1;
+   else if ( gpg_err_code (err) == GPG_ERR_NO_ERROR )
+      return 0;
+   else
+      return 2;
+}
+
+
+
+/*
+Tell the user what remove_key did
+*/
+void report_removal(int status, bool quiet)
+{
+   if ( status == 1 )
       cout << "\t=> " <<  _("Skipping secret key") << endl;
+   else if ( status == 0 ) {
+      if (!quiet)  cout << "\t=> " << _("deleted key") << endl;
+   }
+   else if ( status == 3 )
+      cerr << "\t=> " << _("timed out, will try again later") << endl;
+   else
+      cerr << "\t=> " << _("unknown Error occurred") << endl;
+}
+
+
+
+/*
+List all keys of the keyring and measure how long it takes
+*/
+int time_listing(const options& opts, double& seconds)
+{
+   gpgme_ctx_t ctx;
+   gpgme_key_t key;
+   struct timespec begin, end;
+   gpgme_error_t err = new_context(ctx, opts.trustdbcheck);
+   if (err)
       return 1;
+   clock_gettime(CLOCK_MONOTONIC, &begin);
+   err = gpgme_op_keylist_start (ctx, NULL, 0);
+   while (!err) {
+      err = gpgme_op_keylist_next (ctx, &key);
+      if (!err)
+         gpgme_key_release (key);
    }
-   else if ( gpg_err_code (err) == GPG_ERR_NO_ERROR ) {
-      if (!quiet)  cout << "\t=> " << _("deleted key") << endl;
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   gpgme_release (ctx);
+   if (gpg_err_code (err) != GPG_ERR_EOF) {
+      cerr << _("can not list keys: ") << gpgme_strerror (err) << endl;
+      return 1;
+   }
+   seconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+   return 0;
+}
+
+
+
+/*
+Drop the blobs of deleted keys from the keybox, report the size and the
+time to list all keys before and after
+*/
+int compact_keyring(const string& homedir, const options& opts)
+{
+   string file = homedir + "/pubring.kbx";
+   double before = 0, after = 0;
+   keyboxstats stats;
+   if ( !opts.dry && time_listing(opts, before) )
+      return 10;
+   if ( keybox_compact(file, stats, opts.dry) )
+      return 20;
+   if ( !opts.dry && stats.emptyblobs > 0 && time_listing(opts, after) )
+      return 10;
+   if ( opts.quiet )
       return 0;
+   printf(_("Keybox %s: %lld -> %lld bytes, %ld key(s), %ld empty blob(s) %s\n"),
+          file.c_str(), stats.bytesbefore, stats.bytesafter, stats.blobs - 1,
+          stats.emptyblobs, opts.dry ? _("to remove") : _("removed"));
+   if ( !opts.dry && stats.emptyblobs > 0 )
+      printf(_("Listing all keys: %.3f s -> %.3f s\n"), before, after);
+   return 0;
+}
+
+
+
+/*
+Audit the keys of gpg's colon listing, which is much cheaper than building
+a gpgme_key_t for every key. Only the selected keys are fetched with gpgme,
+to print and delete them.
+returns GPG_ERR_EOF if all keys were listed
+*/
+gpgme_error_t list_colons(gpgme_ctx_t& ctx, gpgme_engine_info_t enginfo, const options& opts,
+                          auditor& keyauditor, const trustdb& trust, const secretkeys& secrets,
+                          watchdog& guard, keywriter& writer, int& count, long& listed,
+                          string& lastkept, int& revokedkeys, int& expiredkeys,
+                          int numberofkeys[6][6])
+{
+   colonlister lister;
+   if ( lister.start(enginfo->file_name, enginfo->home_dir ? enginfo->home_dir : "",
+                     opts.trustdbcheck) )
+      return gpg_error(GPG_ERR_GENERAL);
+   keyrecord record;
+   gpgme_key_t key;
+   while ( lister.next(record, guard.deadline()) ) {
+      if ( record.uids.empty() || record.fpr == "" )
+         continue;
+      listed++;
+      // the key stays in the keyring, unless it is deleted below
+      string previous = lastkept;
+      lastkept = record.fpr;
+      progress_scanned();
+      progress_tick();
+
+      if ( opts.usetrustdb )
+         trust.lookup(record.fpr, record.validity, record.owner_trust);
+      numberofkeys[record.validity][record.owner_trust]++;
+      if ( record.revoked )
+         revokedkeys++;
+      if ( record.expired )
+         expiredkeys++;
+
+      if ( opts.onlystatistics )
+         continue;
+      record.secret = secrets.contains(record.fpr);
+      if ( !keyauditor.test(record) )
+         continue;
+      progress_matched();
+      gpgme_error_t err = get_key(ctx, guard, opts, record.fpr, key);
+      if ( gpg_err_code (err) == GPG_ERR_CANCELED ) {
+         guard.cancelled.push_back(record.fpr);	// tried again at the end
+         continue;
+      }
+      if (err) {
+         cerr << _("can not get key ") << record.fpr << ": " << gpgme_strerror (err) << endl;
+         progress_result(2);
+         continue;
+      }
+      if ( handle_match(guard, key, record, opts, writer) == 0 ) {
+         count++;
+         if ( !opts.prune && !opts.dry )
+            lastkept = previous;
+      }
+      gpgme_key_release (key);
    }
-   else {
-      cerr << "\t=> " << _("unknown Error occurred") << endl;
-      return 2;
+   // gpg got stuck: the caller lists the keys behind 'lastkept' another way
+   bool timedout = lister.timedout();
+   if ( lister.finish() )
+      return gpg_error(timedout ? GPG_ERR_TIMEOUT : GPG_ERR_GENERAL);
+   return gpg_error(GPG_ERR_EOF);
+}
+
+
+
+/*
+Test every key against all rule sets of --what-if in one listing and print
+for each rule set how many keys it selects, how many of them are secret
+(and would be skipped) and how much it overlaps with the others.
+Selected keys are kept as one bit per key and rule set, the overlaps are
+counted afterwards.
+*/
+int what_if(gpgme_ctx_t ctx, gpgme_engine_info_t enginfo, keyfile& dump, const options& opts,
+            vector<auditor>& rules, const vector<string>& names, const trustdb& trust,
+            const secretkeys& secrets)
+{
+   vector<auditor>::size_type n = rules.size();
+   vector<vector<uint64_t> > selected(n);
+   vector<long> secret(n, 0);
+   long keys = 0;
+
+   colonlister lister;
+   gpgme_key_t key;
+   keyrecord record;
+   gpgme_error_t err = 0;
+   if ( opts.colons ) {
+      if ( lister.start(enginfo->file_name, enginfo->home_dir ? enginfo->home_dir : "",
+                        opts.trustdbcheck) )
+         return 10;
    }
+   else
+      err = start_listing(ctx, dump, opts);
+   while (!err) {
+      if ( opts.colons ) {
+         if ( !lister.next(record) ) {
+            err = gpg_error(lister.finish() ? GPG_ERR_GENERAL : GPG_ERR_EOF);
+            break;
+         }
+         if ( record.uids.empty() || record.fpr == "" )
+            continue;
+         record.secret = secrets.contains(record.fpr);
+      }
+      else {
+         err = gpgme_op_keylist_next (ctx, &key);
+         if (err)
+            break;
+         if ( !key->uids || !key->subkeys ) {
+            gpgme_key_release (key);
+            continue;
+         }
+         fill_record(key, record, secrets);
+         gpgme_key_release (key);
+      }
+      if ( opts.usetrustdb )
+         trust.lookup(record.fpr, record.validity, record.owner_trust);
+      progress_scanned();
+
+      if ( keys % 64 == 0 )
+         for ( vector<auditor>::size_type i = 0; i < n; i++ )
+            selected[i].push_back(0);
+      for ( vector<auditor>::size_type i = 0; i < n; i++ )
+         if ( rules[i].test(record) ) {
+            selected[i].back() |= (uint64_t) 1 << (keys % 64);
+            if ( record.secret )
+               secret[i]++;
+         }
+      keys++;
+      progress_tick();
+   }
+   if (gpg_err_code (err) != GPG_ERR_EOF) {
+      cerr << _("can not list keys: ") << gpgme_strerror (err) << endl;
+      return 10;
+   }
+
+   // keys selected by more than one rule set
+   vector<uint64_t> once, twice;
+   for ( vector<auditor>::size_type i = 0; i < n; i++ ) {
+      once.resize(selected[i].size(), 0);
+      twice.resize(selected[i].size(), 0);
+      for ( vector<uint64_t>::size_type w = 0; w < selected[i].size(); w++ ) {
+         twice[w] |= once[w] & selected[i][w];
+         once[w]  |= selected[i][w];
+      }
+   }
+   vector<vector<long> > overlap(n, vector<long>(n, 0));
+   for ( vector<auditor>::size_type i = 0; i < n; i++ )
+      for ( vector<auditor>::size_type j = i; j < n; j++ ) {
+         long both = 0;
+         for ( vector<uint64_t>::size_type w = 0; w < selected[i].size(); w++ )
+            both += __builtin_popcountll(selected[i][w] & selected[j][w]);
+         overlap[i][j] = overlap[j][i] = both;
+      }
+
+   printf(_("What-if for %ld key(s):\n"), keys);
+   printf("%4s %9s %8s %8s %14s  %s\n", "#", _("selected"), _("secret"), _("unique"),
+          _("most overlap"), _("rule set"));
+   for ( vector<auditor>::size_type i = 0; i < n; i++ ) {
+      long unique = 0;
+      for ( vector<uint64_t>::size_type w = 0; w < selected[i].size(); w++ )
+         unique += __builtin_popcountll(selected[i][w] & ~twice[w]);
+      vector<auditor>::size_type most = i;
+      for ( vector<auditor>::size_type j = 0; j < n; j++ )
+         if ( j != i && (most == i || overlap[i][j] > overlap[i][most]) )
+            most = j;
+      char mostoverlap[32] = "-";
+      if ( most != i )
+         snprintf(mostoverlap, sizeof(mostoverlap), "%ld (#%lu)", overlap[i][most],
+                  (unsigned long) most + 1);
+      printf("%4lu %9ld %8ld %8ld %14s  %s\n", (unsigned long) i + 1, overlap[i][i],
+             secret[i], unique, mostoverlap, names[i].c_str());
+   }
+   // the whole matrix only if it fits on the screen
+   if ( n > 1 && n <= 10 ) {
+      printf(_("\nKeys selected by both rule sets:\n"));
+      printf("%4s", "");
+      for ( vector<auditor>::size_type j = 0; j < n; j++ )
+         printf(" %8lu", (unsigned long) j + 1);
+      printf("\n");
+      for ( vector<auditor>::size_type i = 0; i < n; i++ ) {
+         printf("%4lu", (unsigned long) i + 1);
+         for ( vector<auditor>::size_type j = 0; j < n; j++ )
+            printf(" %8ld", overlap[i][j]);
+         printf("\n");
+      }
+   }
+   return 0;
 }
 
+
+
+/*
+Statistics of a random sample of the keys, read directly from the keybox
+and the trustdb, without listing any key
+*/
+int sample_statistics(gpgme_ctx_t ctx, const string& homedir, const options& opts)
+{
+   // everything is read from the files, gpg is not needed
+   gpgme_release (ctx);
+   vector<keyboxkey> sample;
+   unsigned long keys = 0;
+   if ( keybox_sample(homedir + "/pubring.kbx", homedir + "/gpgkeymgr.blobindex",
+                      opts.sample, sample, keys) )
+      return 20;
+   // only the sampled keys are looked up
+   trustdb trust;
+   if ( trust.openmapped(opts.trustdb != "" ? opts.trustdb : homedir + "/trustdb.gpg") )
+      return 19;
+
+   int revokedkeys = 0, expiredkeys = 0;
+   int numberofkeys[6][6];
+   for ( int i=0; i<6; i++)
+      for ( int j=0; j<6; j++)
+         numberofkeys[i][j]=0;
+   long sampled = 0;
+   for ( vector<keyboxkey>::size_type i = 0; i < sample.size(); i++ ) {
+      int validity = 0, owner_trust = 0;
+      trust.lookup(sample[i].fpr, validity, owner_trust);
+      numberofkeys[validity][owner_trust]++;
+      sampled++;
+      if ( sample[i].revoked )
+         revokedkeys++;
+      if ( sample[i].expired )
+         expiredkeys++;
+   }
+   printsampledstatistics(keys, sampled, revokedkeys, expiredkeys, numberofkeys);
+   return 0;
+}
@@ -0,0 +1,468 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <vector>
+#include <climits>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <libintl.h>
+
+#include "history.hpp"
+
+#define _(Text) gettext(Text) // _ as short version of gettext
+
+using namespace std;
+
+/*
+File: the magic, then one record per run:
+  kind ('K' keyframe or 'D' delta), length of the rest (varint),
+  time, mask of the changed values, the changed values
+Numbers are zigzag varints. A delta holds the differences to the previous
+run, a keyframe the differences to zero, i.e. the values themselves.
+Mostly only a few values change between two runs, so a run takes a few
+dozen bytes.
+Next to the history, file.idx holds the time and offset of every keyframe
+(8 bytes each, big endian). Readers start at the keyframe before the first
+run they need instead of at the start of the file.
+*/
+static const char historymagic[8] = { 'G', 'K', 'M', 'H', 'I', 'S', 'T', '1' };
+static const int keyframeinterval = 64;	// records from one keyframe to the next
+static const int maxrows = 40;	// lines of the trend table
+static const char indexsuffix[] = ".idx";
+
+
+historyentry::historyentry()
+: time(0)
+{
+   for ( int i = 0; i < HISTORY_FIELDS; i++ )
+      values[i] = 0;
+}
+
+static void putvarint(string& out, unsigned long long value)
+{
+   while ( value >= 0x80 ) {
+      out += (char) (value | 0x80);
+      value >>= 7;
+   }
+   out += (char) value;
+}
+
+static void putzigzag(string& out, long long value)
+{
+   putvarint(out, ((unsigned long long) value << 1) ^ (value >> 63));
+}
+
+static bool getvarint(const unsigned char*& p, const unsigned char* end,
+                      unsigned long long& value)
+{
+   value = 0;
+   for ( int shift = 0; p < end && shift < 64; shift += 7 ) {
+      unsigned char byte = *p++;
+      value |= (unsigned long long) (byte & 0x7f) << shift;
+      if ( !(byte & 0x80) )
+         return true;
+   }
+   return false;
+}
+
+static bool getzigzag(const unsigned char*& p, const unsigned char* end, long long& value)
+{
+   unsigned long long raw;
+   if ( !getvarint(p, end, raw) )
+      return false;
+   value = (long long) (raw >> 1) ^ -(long long) (raw & 1);
+   return true;
+}
+
+static bool readvarint(FILE* in, unsigned long long& value)
+{
+   value = 0;
+   for ( int shift = 0; shift < 64; shift += 7 ) {
+      int byte = getc(in);
+      if ( byte == EOF )
+         return false;
+      value |= (unsigned long long) (byte & 0x7f) << shift;
+      if ( !(byte & 0x80) )
+         return true;
+   }
+   return false;
+}
+
+
+historyreader::historyreader()
+: reader_file(NULL), reader_end(0), reader_sincekeyframe(0), reader_torn(false)
+  {}
+
+historyreader::~historyreader()
+{
+   if ( reader_file )
+      fclose(reader_file);
+}
+
+/*
+Open the history, returns 1 if it can't be read or is no history
+*/
+int historyreader::open(string file)
+{
+   reader_file = fopen(file.c_str(), "rb");
+   char magic[sizeof(historymagic)];
+   if ( !reader_file || fread(magic, sizeof(magic), 1, reader_file) != 1
+        || memcmp(magic, historymagic, sizeof(magic)) ) {
+      cerr << _("Not a history file: ") << file << endl;
+      return 1;
+   }
+   reader_end = sizeof(historymagic);
+   reader_indexfile = file + indexsuffix;
+   return 0;
+}
+
+static long long getbigendian(const unsigned char* p)
+{
+   unsigned long long value = 0;
+   for ( int i = 0; i < 8; i++ )
+      value = value << 8 | p[i];
+   return (long long) value;
+}
+
+/*
+Go to the last keyframe at or before 'time', found in the index. False if
+the index has none or doesn't fit the history, then the reader stays at the
+start.
+*/
+bool historyreader::seek(long long time)
+{
+   FILE* index = fopen(reader_indexfile.c_str(), "rb");
+   if ( !index )
+      return false;
+   historyframe frame(0, 0);
+   unsigned char item[16];
+   while ( fread(item, sizeof(item), 1, index) == 1 && getbigendian(item) <= time )
+      frame = historyframe(getbigendian(item), (long) getbigendian(item + 8));
+   fclose(index);
+   if ( frame.second < (long) sizeof(historymagic) )
+      return false;
+
+   // the record there has to be the keyframe of that time
+   historyentry entry;
+   if ( fseek(reader_file, frame.second, SEEK_SET) == 0 && next(entry)
+        && reader_sincekeyframe == 0 && entry.time == frame.first ) {
+      fseek(reader_file, frame.second, SEEK_SET);
+      reader_end = frame.second;
+      return true;
+   }
+   fseek(reader_file, sizeof(historymagic), SEEK_SET);
+   reader_end = sizeof(historymagic);
+   reader_state = historyentry();
+   reader_sincekeyframe = 0;
+   return false;
+}
+
+/*
+The next run, false at the end or at a damaged record
+*/
+bool historyreader::next(historyentry& entry)
+{
+   reader_torn = false;
+   int kind = getc(reader_file);
+   if ( kind != 'K' && kind != 'D' )
+      return false;
+   unsigned long long length;
+   if ( !readvarint(reader_file, length) ) {
+      reader_torn = feof(reader_file);
+      return false;
+   }
+   if ( length > 16 * (HISTORY_FIELDS + 2) )
+      return false;
+   vector<unsigned char> payload(length);
+   if ( length > 0 && fread(&payload[0], length, 1, reader_file) != 1 ) {
+      reader_torn = feof(reader_file);
+      return false;
+   }
+
+   historyentry state = kind == 'K' ? historyentry() : reader_state;
+   const unsigned char* p = length > 0 ? &payload[0] : NULL;
+   const unsigned char* end = p + length;
+   long long delta;
+   unsigned long long mask;
+   if ( !getzigzag(p, end, delta) || !getvarint(p, end, mask) )
+      return false;
+   state.time += delta;
+   for ( int i = 0; i < HISTORY_FIELDS; i++ )
+      if ( mask & (1ULL << i) ) {
+         if ( !getzigzag(p, end, delta) )
+            return false;
+         state.values[i] += delta;
+      }
+   if ( p != end )
+      return false;
+
+   reader_state = entry = state;
+   reader_sincekeyframe = kind == 'K' ? 0 : reader_sincekeyframe + 1;
+   reader_end = ftell(reader_file);
+   return true;
+}
+
+/*
+Offset behind the last record which could be read
+*/
+long historyreader::goodend() const
+{
+   return reader_end;
+}
+
+/*
+Test if the record next() stopped at was cut off by the end of the file
+*/
+bool historyreader::torn() const
+{
+   return reader_torn;
+}
+
+
+
+static void putbigendian(string& out, long long value)
+{
+   for ( int shift = 56; shift >= 0; shift -= 8 )
+      out += (char) (value >> shift);
+}
+
+/*
+Add keyframes to the index, or write it anew if 'rebuild'
+*/
+static int writeindex(string file, const vector<historyframe>& frames, bool rebuild)
+{
+   if ( frames.empty() && !rebuild )
+      return 0;
+   string items;
+   for ( vector<historyframe>::size_type i = 0; i < frames.size(); i++ ) {
+      putbigendian(items, frames[i].first);
+      putbigendian(items, frames[i].second);
+   }
+   FILE* index = fopen((file + indexsuffix).c_str(), rebuild ? "wb" : "ab");
+   bool ok = index && (items.empty() || fwrite(items.data(), items.size(), 1, index) == 1);
+   if ( index )
+      ok = fclose(index) == 0 && ok;
+   if ( !ok ) {
+      cerr << _("Can't write history-file ") << file << indexsuffix << endl;
+      return 1;
+   }
+   return 0;
+}
+
+/*
+Append a run to the history, the file is created if needed. A record which
+was only written partly (crash) at the end is cut off, any other damage is an
+error and nothing is appended.
+*/
+int history_append(string file, const historyentry& entry)
+{
+   FILE* out = fopen(file.c_str(), "ab");
+   if ( !out || flock(fileno(out), LOCK_EX) != 0 ) {
+      cerr << _("Can't write history-file ") << file << endl;
+      if ( out )
+         fclose(out);
+      return 1;
+   }
+   historyreader reader;
+   vector<historyframe> frames;	// keyframes missing in the index
+   bool rebuild = true;
+   fseek(out, 0, SEEK_END);
+   if ( ftell(out) == 0 ) {
+      if ( fwrite(historymagic, sizeof(historymagic), 1, out) != 1 ) {
+         cerr << _("Can't write history-file ") << file << endl;
+         fclose(out);
+         return 1;
+      }
+   }
+   else {
+      if ( reader.open(file) ) {
+         fclose(out);
+         return 1;
+      }
+      // from the last keyframe on, all of it if the index is missing
+      rebuild = !reader.seek(LLONG_MAX);
+      long indexed = rebuild ? 0 : reader.goodend();
+      historyentry last;
+      for ( long start = reader.goodend(); reader.next(last); start = reader.goodend() )
+         if ( reader.reader_sincekeyframe == 0 && start != indexed )
+            frames.push_back(historyframe(last.time, start));
+      // Only a record cut off by a crash may go, a damaged one in between
+      // would take all later runs with it
+      if ( reader.goodend() < ftell(out) && !reader.torn() ) {
+         cerr << _("History-file is damaged at offset ") << reader.goodend() << ": "
+              << file << endl;
+         fclose(out);
+         return 1;
+      }
+      if ( reader.goodend() < ftell(out) && ftruncate(fileno(out), reader.goodend()) != 0 ) {
+         cerr << _("Can't write history-file ") << file << endl;
+         fclose(out);
+         return 1;
+      }
+      fseek(out, 0, SEEK_END);
+   }
+
+   bool keyframe = reader.goodend() <= (long) sizeof(historymagic)
+                   || reader.reader_sincekeyframe + 1 >= keyframeinterval;
+   const historyentry base = keyframe ? historyentry() : reader.reader_state;
+   string payload, record;
+   unsigned long long mask = 0;
+   for ( int i = 0; i < HISTORY_FIELDS; i++ )
+      if ( entry.values[i] != base.values[i] )
+         mask |= 1ULL << i;
+   putzigzag(payload, entry.time - base.time);
+   putvarint(payload, mask);
+   for ( int i = 0; i < HISTORY_FIELDS; i++ )
+      if ( mask & (1ULL << i) )
+         putzigzag(payload, entry.values[i] - base.values[i]);
+   record += keyframe ? 'K' : 'D';
+   putvarint(record, payload.size());
+   record += payload;
+
+   if ( keyframe )
+      frames.push_back(historyframe(entry.time, ftell(out)));
+   bool ok = fwrite(record.data(), record.size(), 1, out) == 1;
+   ok = fflush(out) == 0 && ok;
+   ok = fsync(fileno(out)) == 0 && ok;
+   if ( !ok ) {
+      cerr << _("Can't write history-file ") << file << endl;
+      fclose(out);
+      return 1;
+   }
+   // still under the lock, and only once the record is safe
+   int error = writeindex(file, frames, rebuild);
+   if ( fclose(out) != 0 ) {
+      cerr << _("Can't write history-file ") << file << endl;
+      return 1;
+   }
+   return error;
+}
+
+
+
+static long long keys(const historyentry& entry)
+{
+   long long sum = 0;
+   for ( int i = HISTORY_MATRIX; i < HISTORY_MATRIX + 36; i++ )
+      sum += entry.values[i];
+   return sum;
+}
+
+static long long validity(const historyentry& entry, int v)
+{
+   long long sum = 0;
+   for ( int j = 0; j < 6; j++ )
+      sum += entry.values[HISTORY_MATRIX + 6 * v + j];
+   return sum;
+}
+
+static string date(long long time)
+{
+   char text[16];
+   time_t t = time;
+   struct tm day;
+   strftime(text, sizeof(text), "%Y-%m-%d", localtime_r(&t, &day));
+   return text;
+}
+
+static void trendrow(const historyentry& entry)
+{
+   printf("%-10s %9lld %8lld %8lld %8lld", date(entry.time).c_str(), keys(entry),
+          entry.values[HISTORY_REVOKED], entry.values[HISTORY_EXPIRED],
+          entry.values[HISTORY_DELETED]);
+   for ( int v = 0; v < 6; v++ )
+      printf(" %8lld", validity(entry, v));
+   printf("\n");
+}
+
+static void growth(const char* name, long long first, long long last, double days)
+{
+   printf("%-12s %+10lld", name, last - first);
+   if ( first != 0 )
+      printf(" (%+.1f%%)", 100.0 * (last - first) / first);
+   else
+      printf("         ");
+   if ( days > 0 )
+      printf("  %+.1f %s", (last - first) * 30 / days, _("per 30 days"));
+   printf("\n");
+}
+
+/*
+Print the runs between 'since' and 'until' (0 for no limit) and how the
+keyring changed. The runs are read twice, the first pass only counts; both
+start at the keyframe before 'since'.
+*/
+int history_trend(string file, long long since, long long until)
+{
+   historyreader counter;
+   if ( counter.open(file) )
+      return 1;
+   counter.seek(since);
+   historyentry entry, first, last;
+   long runs = 0;
+   long long deleted = 0;
+   while ( counter.next(entry) )
+      if ( entry.time >= since && (until == 0 || entry.time <= until) ) {
+         if ( runs == 0 )
+            first = entry;
+         last = entry;
+         deleted += entry.values[HISTORY_DELETED];
+         runs++;
+      }
+   if ( runs == 0 ) {
+      cout << _("No runs in this time range") << endl;
+      return 0;
+   }
+
+   printf(_("Statistics history, %ld run(s) from %s to %s:\n"), runs,
+          date(first.time).c_str(), date(last.time).c_str());
+   printf("%-10s %9s %8s %8s %8s", _("date"), _("keys"), _("revoked"), _("expired"),
+          _("deleted"));
+   for ( int v = 0; v < 6; v++ )
+      printf(" %7s%d", _("valid"), v);
+   printf("\n");
+   // every step-th run, and the last one
+   long step = (runs + maxrows - 1) / maxrows;
+   historyreader reader;
+   if ( reader.open(file) )
+      return 1;
+   reader.seek(since);
+   long run = 0;
+   while ( reader.next(entry) )
+      if ( entry.time >= since && (until == 0 || entry.time <= until) ) {
+         if ( run % step == 0 || run == runs - 1 )
+            trendrow(entry);
+         run++;
+      }
+
+   double days = (last.time - first.time) / 86400.0;
+   printf(_("\nChange in %.0f day(s):\n"), days);
+   growth(_("keys"), keys(first), keys(last), days);
+   growth(_("revoked"), first.values[HISTORY_REVOKED], last.values[HISTORY_REVOKED], days);
+   growth(_("expired"), first.values[HISTORY_EXPIRED], last.values[HISTORY_EXPIRED], days);
+   for ( int v = 0; v < 6; v++ ) {
+      string name = _("validity ") + to_string(v);
+      growth(name.c_str(), validity(first, v), validity(last, v), days);
+   }
+   printf(_("Deleted in this time: %lld key(s)\n"), deleted);
+   return 0;
+}
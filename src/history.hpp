@@ -0,0 +1,77 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include <utility>
+#include <stdio.h>
+using namespace std;
+
+#ifndef _history_hpp_
+#define _history_hpp_
+
+// The values of a run, numberofkeys[i][j] is HISTORY_MATRIX + 6*i + j
+enum {
+   HISTORY_MATRIX  = 0,
+   HISTORY_REVOKED = 36,
+   HISTORY_EXPIRED,
+   HISTORY_DELETED,
+   HISTORY_SKIPPED,
+   HISTORY_FAILED,
+   HISTORY_FIELDS
+};
+
+// One run in the statistics history
+struct historyentry {
+   historyentry();
+   long long time;	// s since the epoch
+   long long values[HISTORY_FIELDS];
+};
+
+/*
+Reads a history file record by record, so even years of runs take no memory
+*/
+class historyreader{
+
+  public:
+    historyreader();
+    ~historyreader();
+    int open(string file);
+    bool seek(long long time);
+    bool next(historyentry&);
+    long goodend() const;
+    bool torn() const;
+
+  private:
+    FILE*        reader_file;
+    string       reader_indexfile;	// offsets of the keyframes
+    historyentry reader_state;	// the last entry, base of the next delta
+    long         reader_end;	// offset behind the last complete record
+    int          reader_sincekeyframe;	// records since the last keyframe
+    bool         reader_torn;	// the last record ends with the file, cut off by a crash
+
+    friend int history_append(string, const historyentry&);
+};
+
+// Time and offset of a keyframe
+typedef pair<long long, long> historyframe;
+
+int history_append(string file, const historyentry& entry);
+int history_trend(string file, long long since, long long until);
+
+#endif
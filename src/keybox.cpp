@@ -0,0 +1,650 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <set>
+#include <errno.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <libintl.h>
+
+#include "keybox.hpp"
+#include "stringutil.hpp"
+
+#define _(Text) gettext(Text) // _ as short version of gettext
+
+using namespace std;
+
+// see kbx/keybox-blob.c of gnupg
+static const unsigned char blobtype_empty  = 0;
+static const unsigned char blobtype_header = 1;
+static const unsigned char blobtype_pgp    = 2;
+static const size_t pgpkeyinfo = 20;	// offset of the first key in an OpenPGP blob
+static const unsigned short keyflag_fpr32 = 0x80;	// v2 blob: 32 byte fingerprint
+static const size_t keyinfo_v2 = 56;	// v2 blob key: fpr[32], flags, rfu, keygrip[20]
+static const size_t keyinfo_v2flags = 32;
+static const size_t headerlength = 32;
+static const size_t lastmaintenance = 20;	// offset in the header blob
+
+static const int locktries = 100;	// wait 10s for gpg to release the keybox
+
+
+keyboxstats::keyboxstats()
+: bytesbefore(0), bytesafter(0), blobs(0), emptyblobs(0)
+  {}
+
+keyboxkey::keyboxkey()
+: fpr(""), created(0), revoked(false), expired(false)
+  {}
+
+static unsigned long readulong(const unsigned char* p)
+{
+   return ((unsigned long) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static void writeulong(unsigned char* p, unsigned long value)
+{
+   p[0] = value >> 24;	p[1] = value >> 16;
+   p[2] = value >> 8;	p[3] = value;
+}
+
+/*
+Split the keybox into blobs, pairs of offset and length
+returns false if the keybox is damaged
+*/
+static bool readblobs(const unsigned char* kbx, size_t length,
+                      vector<pair<size_t, size_t> >& blobs)
+{
+   size_t pos = 0;
+   while ( pos < length ) {
+      if ( length - pos < 5 )
+         return false;
+      size_t bloblength = readulong(kbx + pos);
+      if ( bloblength < 5 || bloblength > length - pos )
+         return false;
+      blobs.push_back(make_pair(pos, bloblength));
+      pos += bloblength;
+   }
+   return !blobs.empty() && kbx[blobs[0].first + 4] == blobtype_header
+          && blobs[0].second >= headerlength;
+}
+
+static bool writeall(int fd, const unsigned char* data, size_t length)
+{
+   while ( length > 0 ) {
+      ssize_t written = write(fd, data, length);
+      if ( written < 0 && errno == EINTR )
+         continue;
+      if ( written <= 0 )
+         return false;
+      data   += written;
+      length -= written;
+   }
+   return true;
+}
+
+static void *mapfile(string file, size_t& length)
+{
+   int fd = open(file.c_str(), O_RDONLY);
+   struct stat fileinfo;
+   void *map = MAP_FAILED;
+   if ( fd >= 0 && fstat(fd, &fileinfo) == 0 && fileinfo.st_size > 0 ) {
+      length = fileinfo.st_size;
+      map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+   }
+   if ( fd >= 0 )
+      close(fd);
+   return map == MAP_FAILED ? NULL : map;
+}
+
+/*
+Lock the keybox the way gpg does (dotlock): link a file with our pid
+and node name to 'file'.lock. Stale locks of dead processes are removed.
+*/
+static bool dotlock_take(const string& file, string& tmpname)
+{
+   struct utsname node;
+   if ( uname(&node) != 0 )
+      strcpy(node.nodename, "unknown");
+   string dir = file.find('/') != string::npos ? file.substr(0, file.rfind('/')) : ".";
+   tmpname = dir + "/.#lkgpgkeymgr." + string(node.nodename)
+           + "." + NumberToString(getpid());
+   string lockname = file + ".lock";
+
+   char content[300];
+   int contentlength = snprintf(content, sizeof(content), "%10d\n%s\n",
+                                (int) getpid(), node.nodename);
+   int fd = open(tmpname.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+   if ( fd < 0 )
+      return false;
+   bool ok = writeall(fd, (const unsigned char*) content, contentlength);
+   if ( close(fd) != 0 || !ok ) {
+      unlink(tmpname.c_str());
+      return false;
+   }
+
+   for ( int tries = 0; tries < locktries; tries++ ) {
+      struct stat info;
+      if ( link(tmpname.c_str(), lockname.c_str()) == 0
+           || (stat(tmpname.c_str(), &info) == 0 && info.st_nlink == 2) )
+         return true;
+      // a lock of a process which is gone on this node
+      FILE* lock = fopen(lockname.c_str(), "r");
+      if ( lock ) {
+         int pid = 0;
+         char lockednode[256] = "";
+         bool read = fscanf(lock, "%d %255s", &pid, lockednode) == 2;
+         fclose(lock);
+         if ( read && pid > 0 && pid != getpid() && !strcmp(lockednode, node.nodename)
+              && kill(pid, 0) != 0 && errno == ESRCH ) {
+            cerr << _("Removing stale lock of process ") << pid << endl;
+            unlink(lockname.c_str());
+            continue;
+         }
+      }
+      usleep(100000);
+   }
+   cerr << _("The keybox is locked: ") << lockname << endl;
+   unlink(tmpname.c_str());
+   return false;
+}
+
+static void dotlock_release(const string& file, const string& tmpname)
+{
+   unlink((file + ".lock").c_str());
+   unlink(tmpname.c_str());
+}
+
+/*
+Compare the written keybox with the live blobs of the original
+*/
+static bool verify(const string& tmpfile, const unsigned char* kbx,
+                   const vector<pair<size_t, size_t> >& live, size_t expected)
+{
+   size_t length = 0;
+   const unsigned char* written = (const unsigned char*) mapfile(tmpfile, length);
+   if ( !written )
+      return false;
+   vector<pair<size_t, size_t> > blobs;
+   bool ok = length == expected && readblobs(written, length, blobs) && blobs.size() == live.size();
+   // the header differs in the time of the last maintenance
+   for ( vector<pair<size_t, size_t> >::size_type i = 0; ok && i < blobs.size(); i++ ) {
+      const unsigned char* blob = written + blobs[i].first;
+      const unsigned char* original = kbx + live[i].first;
+      ok = blobs[i].second == live[i].second
+           && (i == 0 ? memcmp(blob, original, lastmaintenance) == 0
+                        && memcmp(blob + lastmaintenance + 4, original + lastmaintenance + 4,
+                                  blobs[i].second - lastmaintenance - 4) == 0
+                      : memcmp(blob, original, blobs[i].second) == 0);
+   }
+   munmap((void*) written, length);
+   return ok;
+}
+
+/*
+Write the keybox 'file' again without the blobs of deleted keys, verify
+it and replace the original atomically. gpg keeps the old one as 'file'~.
+With 'dry' only count what would be dropped.
+returns 0 on success, 1 on error (the keybox is left alone then)
+*/
+int keybox_compact(string file, keyboxstats& stats, bool dry)
+{
+   string tmpname;
+   if ( !dotlock_take(file, tmpname) )
+      return 1;
+
+   size_t length = 0;
+   const unsigned char* kbx = (const unsigned char*) mapfile(file, length);
+   struct stat fileinfo;
+   if ( !kbx || stat(file.c_str(), &fileinfo) != 0 ) {
+      cerr << _("Failed to open ") << file << endl;
+      if ( kbx )
+         munmap((void*) kbx, length);
+      dotlock_release(file, tmpname);
+      return 1;
+   }
+   stats.bytesbefore = stats.bytesafter = length;
+
+   vector<pair<size_t, size_t> > blobs, live;
+   if ( !readblobs(kbx, length, blobs) ) {
+      cerr << _("Not a keybox or damaged: ") << file << endl;
+      munmap((void*) kbx, length);
+      dotlock_release(file, tmpname);
+      return 1;
+   }
+   size_t livelength = 0;
+   for ( vector<pair<size_t, size_t> >::size_type i = 0; i < blobs.size(); i++ )
+      if ( kbx[blobs[i].first + 4] == blobtype_empty )
+         stats.emptyblobs++;
+      else {
+         live.push_back(blobs[i]);
+         livelength += blobs[i].second;
+      }
+   stats.blobs = live.size();
+   if ( dry )
+      stats.bytesafter = livelength;
+   if ( stats.emptyblobs == 0 || dry ) {
+      munmap((void*) kbx, length);
+      dotlock_release(file, tmpname);
+      return 0;
+   }
+
+   string tmpfile = file + ".tmp";
+   int fd = open(tmpfile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, fileinfo.st_mode & 07777);
+   bool ok = fd >= 0;
+   // the header, with the time of this maintenance run
+   vector<unsigned char> header(kbx, kbx + live[0].second);
+   writeulong(&header[lastmaintenance], time(NULL));
+   ok = ok && writeall(fd, &header[0], header.size());
+   // runs of adjacent blobs in one write
+   for ( vector<pair<size_t, size_t> >::size_type i = 1; ok && i < live.size(); ) {
+      size_t begin = live[i].first, end = begin + live[i].second;
+      for ( i++; i < live.size() && live[i].first == end; i++ )
+         end += live[i].second;
+      ok = writeall(fd, kbx + begin, end - begin);
+   }
+   if ( fd >= 0 ) {
+      ok = fsync(fd) == 0 && ok;
+      ok = close(fd) == 0 && ok;
+   }
+   ok = ok && verify(tmpfile, kbx, live, livelength);
+   munmap((void*) kbx, length);
+   if ( !ok ) {
+      cerr << _("Failed to write compacted keybox ") << tmpfile << endl;
+      unlink(tmpfile.c_str());
+      dotlock_release(file, tmpname);
+      return 1;
+   }
+
+   string backupfile = file + "~";
+   unlink(backupfile.c_str());
+   if ( link(file.c_str(), backupfile.c_str()) != 0 )
+      cerr << _("Warning: could not keep the old keybox as ") << backupfile << endl;
+   if ( rename(tmpfile.c_str(), file.c_str()) != 0 ) {
+      cerr << _("Failed to replace ") << file << endl;
+      unlink(tmpfile.c_str());
+      dotlock_release(file, tmpname);
+      return 1;
+   }
+   stats.bytesafter = livelength;
+   dotlock_release(file, tmpname);
+   return 0;
+}
+
+
+
+// Cached offsets of the OpenPGP blobs, valid for one size and mtime of the keybox
+struct blobindexheader {
+   char     magic[16];
+   uint64_t size;
+   uint64_t mtime;	// ns
+   uint64_t count;
+};
+static const char blobindexmagic[16] = "gpgkeymgr-idx-1";
+
+static uint64_t mtime(const struct stat& info)
+{
+   return (uint64_t) info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+}
+
+/*
+Offsets of all OpenPGP blobs, from the index if it belongs to this keybox,
+else by walking the keybox (and saving the index for the next time)
+*/
+static int bloboffsets(const unsigned char* kbx, size_t length, const struct stat& info,
+                       string indexfile, vector<uint64_t>& offsets)
+{
+   blobindexheader header;
+   FILE* in = fopen(indexfile.c_str(), "rb");
+   if ( in ) {
+      bool valid = fread(&header, sizeof(header), 1, in) == 1
+                   && !memcmp(header.magic, blobindexmagic, sizeof(header.magic))
+                   && header.size == (uint64_t) length && header.mtime == mtime(info)
+                   && header.count <= length / 5;
+      if ( valid ) {
+         offsets.resize(header.count);
+         valid = header.count == 0
+                 || fread(&offsets[0], sizeof(uint64_t), header.count, in) == header.count;
+      }
+      fclose(in);
+      if ( valid )
+         return 0;
+      offsets.clear();
+   }
+
+   vector<pair<size_t, size_t> > blobs;
+   if ( !readblobs(kbx, length, blobs) )
+      return 1;
+   for ( vector<pair<size_t, size_t> >::size_type i = 0; i < blobs.size(); i++ )
+      if ( kbx[blobs[i].first + 4] == blobtype_pgp )
+         offsets.push_back(blobs[i].first);
+
+   memcpy(header.magic, blobindexmagic, sizeof(header.magic));
+   header.size  = length;
+   header.mtime = mtime(info);
+   header.count = offsets.size();
+   string tmpfile = indexfile + ".tmp";
+   FILE* out = fopen(tmpfile.c_str(), "wb");
+   if ( out ) {
+      bool ok = fwrite(&header, sizeof(header), 1, out) == 1
+                && (offsets.empty()
+                    || fwrite(&offsets[0], sizeof(uint64_t), offsets.size(), out) == offsets.size());
+      if ( fclose(out) == 0 && ok )
+         rename(tmpfile.c_str(), indexfile.c_str());
+      else
+         unlink(tmpfile.c_str());
+   }
+   return 0;
+}
+
+/*
+Length of an OpenPGP packet or subpacket (new format), false if it does not
+fit in [p, end)
+*/
+static bool readlength(const unsigned char*& p, const unsigned char* end, size_t& length)
+{
+   if ( p >= end )
+      return false;
+   if ( *p < 192 )
+      length = *p++;
+   else if ( *p < 224 || *p == 255 ) {
+      if ( *p == 255 ) {
+         if ( end - p < 5 )
+            return false;
+         length = readulong(p + 1);
+         p += 5;
+      }
+      else {
+         if ( end - p < 2 )
+            return false;
+         length = ((p[0] - 192) << 8) + p[1] + 192;
+         p += 2;
+      }
+   }
+   else
+      return false;	// partial lengths don't occur in keys
+   return length <= (size_t) (end - p);
+}
+
+/*
+The next packet of a keyblock, its tag and body [body, body+length)
+*/
+static bool readpacket(const unsigned char*& p, const unsigned char* end, int& tag,
+                       const unsigned char*& body, size_t& length)
+{
+   if ( p >= end || !(*p & 0x80) )
+      return false;
+   unsigned char ctb = *p++;
+   if ( ctb & 0x40 ) {
+      tag = ctb & 0x3f;
+      if ( !readlength(p, end, length) )
+         return false;
+   }
+   else {
+      tag = (ctb >> 2) & 15;
+      int bytes = 1 << (ctb & 3);
+      if ( (ctb & 3) == 3 || end - p < bytes )
+         return false;
+      length = 0;
+      for ( int i = 0; i < bytes; i++ )
+         length = (length << 8) | *p++;
+      if ( length > (size_t) (end - p) )
+         return false;
+   }
+   body = p;
+   p += length;
+   return true;
+}
+
+// What a signature says about its key, see RFC 4880 5.2
+struct signature {
+   int type;
+   unsigned long created;
+   unsigned long keyexpires;	// s after creation of the key, 0 for never
+   bool byself;	// issued by the primary key
+};
+
+/*
+Walk the subpackets in [p, end) for creation and key expiration time and the
+issuer, which is compared with the key id 'keyid'
+*/
+static bool readsubpackets(const unsigned char* p, const unsigned char* end,
+                           const unsigned char* keyid, signature& sig)
+{
+   while ( p < end ) {
+      size_t length;
+      if ( !readlength(p, end, length) || length == 0 )
+         return false;
+      int type = *p & 0x7f;
+      const unsigned char* data = p + 1;
+      size_t datalength = length - 1;
+      if ( type == 2 && datalength == 4 )
+         sig.created = readulong(data);
+      else if ( type == 9 && datalength == 4 )
+         sig.keyexpires = readulong(data);
+      else if ( type == 16 && datalength == 8 )
+         sig.byself = sig.byself || !memcmp(data, keyid, 8);
+      else if ( type == 33 && datalength >= 21 ) {
+         // version and fingerprint, the key id is at its end (v4) or start (v5+)
+         const unsigned char* id = data[0] == 4 ? data + datalength - 8 : data + 1;
+         sig.byself = sig.byself || !memcmp(id, keyid, 8);
+      }
+      p += length;
+   }
+   return true;
+}
+
+/*
+Read a signature packet, false for versions we don't know
+*/
+static bool readsignature(const unsigned char* p, size_t length, const unsigned char* keyid,
+                          signature& sig)
+{
+   const unsigned char* end = p + length;
+   sig.created = sig.keyexpires = 0;
+   sig.byself = false;
+   if ( length < 1 )
+      return false;
+   if ( p[0] == 3 ) {
+      if ( length < 15 )
+         return false;
+      sig.type    = p[2];
+      sig.created = readulong(p + 3);
+      sig.byself  = !memcmp(p + 7, keyid, 8);
+      return true;
+   }
+   if ( p[0] < 4 || p[0] > 6 || length < 4 )
+      return false;
+   sig.type = p[1];
+   size_t counter = p[0] == 6 ? 4 : 2;	// size of the subpacket lengths
+   p += 4;
+   for ( int area = 0; area < 2; area++ ) {
+      if ( (size_t) (end - p) < counter )
+         return false;
+      size_t arealength = counter == 4 ? readulong(p) : (p[0] << 8) | p[1];
+      p += counter;
+      if ( arealength > (size_t) (end - p) || !readsubpackets(p, p + arealength, keyid, sig) )
+         return false;
+      p += arealength;
+   }
+   return true;
+}
+
+/*
+Revocation and expiration of the primary key from the signatures in front
+of the first subkey. Signatures are not verified, it's only an estimate.
+*/
+static void readkeyblock(const unsigned char* p, const unsigned char* end,
+                         const unsigned char* keyid, keyboxkey& key)
+{
+   int tag;
+   const unsigned char* body;
+   size_t length;
+   if ( !readpacket(p, end, tag, body, length) || tag != 6 || length < 5 )
+      return;
+   key.created = readulong(body + 1);
+   unsigned long newest = 0, expires = 0;
+   while ( readpacket(p, end, tag, body, length) && tag != 14 ) {
+      signature sig;
+      if ( tag != 2 || !readsignature(body, length, keyid, sig) || !sig.byself )
+         continue;
+      if ( sig.type == 0x20 )
+         key.revoked = true;
+      else if ( ((sig.type >= 0x10 && sig.type <= 0x13) || sig.type == 0x1f)
+                && sig.created >= newest ) {
+         newest  = sig.created;
+         expires = sig.keyexpires;
+      }
+   }
+   key.expired = expires > 0 && key.created + (long) expires <= time(NULL);
+}
+
+/*
+Fingerprint of the primary key of the OpenPGP blob at 'offset', "" if the
+blob was deleted meanwhile
+*/
+static string blobfingerprint(const unsigned char* kbx, size_t length, uint64_t offset)
+{
+   if ( offset > length || length - offset < pgpkeyinfo + 20 )
+      return "";
+   const unsigned char* blob = kbx + offset;
+   size_t bloblength = readulong(blob);
+   unsigned short keyinfosize = (blob[18] << 8) | blob[19];
+   if ( blob[4] != blobtype_pgp || bloblength > length - offset
+        || bloblength < pgpkeyinfo + keyinfosize || keyinfosize < 20 )
+      return "";
+   size_t fprlength = 20;
+   if ( blob[5] >= 2 && keyinfosize >= keyinfo_v2
+        && (((blob[pgpkeyinfo + keyinfo_v2flags] << 8) | blob[pgpkeyinfo + keyinfo_v2flags + 1])
+            & keyflag_fpr32) )
+      fprlength = 32;
+   static const char hex[] = "0123456789ABCDEF";
+   string fpr(2 * fprlength, '0');
+   for ( size_t i = 0; i < fprlength; i++ ) {
+      fpr[2*i]   = hex[blob[pgpkeyinfo + i] >> 4];
+      fpr[2*i+1] = hex[blob[pgpkeyinfo + i] & 15];
+   }
+   return fpr;
+}
+
+/*
+The key of the OpenPGP blob at 'offset', false if the blob was deleted
+meanwhile
+*/
+static bool blobkey(const unsigned char* kbx, size_t length, uint64_t offset, keyboxkey& key)
+{
+   key.fpr = blobfingerprint(kbx, length, offset);
+   if ( key.fpr == "" )
+      return false;
+   const unsigned char* blob = kbx + offset;
+   size_t bloblength = readulong(blob);
+   // the key id is the end of a v4 fingerprint, the start of a longer one
+   const unsigned char* keyid = blob + pgpkeyinfo + (key.fpr.length() == 40 ? 12 : 0);
+   size_t keyblock = readulong(blob + 8), keyblocklength = readulong(blob + 12);
+   if ( keyblock <= bloblength && keyblocklength <= bloblength - keyblock )
+      readkeyblock(blob + keyblock, blob + keyblock + keyblocklength, keyid, key);
+   return true;
+}
+
+/*
+Draw a uniform random sample of 'samplesize' keys from the keybox, without
+listing it: the offsets of the blobs come from a cached index, a random
+subset of them (Floyd's algorithm) is read directly, keyblocks included.
+'keys' gets the number of keys in the keybox.
+returns 0 on success, 1 on error
+*/
+int keybox_sample(string file, string indexfile, unsigned long samplesize,
+                  vector<keyboxkey>& sample, unsigned long& keys)
+{
+   size_t length = 0;
+   struct stat info;
+   const unsigned char* kbx = (const unsigned char*) mapfile(file, length);
+   if ( !kbx || stat(file.c_str(), &info) != 0 ) {
+      cerr << _("Failed to open ") << file << endl;
+      if ( kbx )
+         munmap((void*) kbx, length);
+      return 1;
+   }
+   vector<uint64_t> offsets;
+   if ( bloboffsets(kbx, length, info, indexfile, offsets) ) {
+      cerr << _("Not a keybox or damaged: ") << file << endl;
+      munmap((void*) kbx, length);
+      return 1;
+   }
+   keys = offsets.size();
+
+   // Floyd: every subset of the offsets is equally likely
+   mt19937_64 random(random_device{}());
+   set<uint64_t> chosen;
+   unsigned long n = offsets.size();
+   unsigned long m = samplesize < n ? samplesize : n;
+   for ( unsigned long j = n - m; j < n; j++ ) {
+      uint64_t t = uniform_int_distribution<uint64_t>(0, j)(random);
+      if ( !chosen.insert(t).second )
+         chosen.insert(j);
+   }
+   for ( set<uint64_t>::iterator it = chosen.begin(); it != chosen.end(); it++ ) {
+      keyboxkey key;
+      if ( blobkey(kbx, length, offsets[*it], key) )
+         sample.push_back(key);
+   }
+   munmap((void*) kbx, length);
+   return 0;
+}
+
+/*
+Fingerprints of the keys behind the key 'after' (all keys for "") in the
+order of the keybox, which is the order gpg lists them in
+returns 0 on success, 1 if the keybox can't be read or 'after' is not in it
+*/
+int keybox_behind(string file, string after, vector<string>& fprs)
+{
+   size_t length = 0;
+   const unsigned char* kbx = (const unsigned char*) mapfile(file, length);
+   if ( !kbx ) {
+      cerr << _("Failed to open ") << file << endl;
+      return 1;
+   }
+   vector<pair<size_t, size_t> > blobs;
+   bool valid = readblobs(kbx, length, blobs);
+   bool found = after == "";
+   for ( vector<pair<size_t, size_t> >::size_type i = 0; valid && i < blobs.size(); i++ ) {
+      string fpr = blobfingerprint(kbx, length, blobs[i].first);
+      if ( fpr == "" )
+         continue;
+      if ( found )
+         fprs.push_back(fpr);
+      else
+         found = fpr == after;
+   }
+   munmap((void*) kbx, length);
+   if ( !valid )
+      cerr << _("Not a keybox or damaged: ") << file << endl;
+   return valid && found ? 0 : 1;
+}
@@ -0,0 +1,50 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#ifndef _keybox_hpp_
+#define _keybox_hpp_
+
+// What the compaction of a keybox did
+struct keyboxstats {
+   keyboxstats();
+   long long bytesbefore;
+   long long bytesafter;
+   long blobs;	// blobs kept, including the header blob
+   long emptyblobs;	// blobs of deleted keys, dropped
+};
+
+// A key as read from its keybox blob, without gpg
+struct keyboxkey {
+   keyboxkey();
+   string fpr;	// fingerprint of the primary key
+   long created;
+   bool revoked;	// has a revocation signature by itself (not verified)
+   bool expired;	// per its newest self-signature
+};
+
+int keybox_compact(string file, keyboxstats& stats, bool dry);
+int keybox_sample(string file, string indexfile, unsigned long samplesize,
+                  vector<keyboxkey>& sample, unsigned long& keys);
+int keybox_behind(string file, string after, vector<string>& fprs);
+
+#endif
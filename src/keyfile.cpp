@@ -0,0 +1,121 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <libintl.h>
+
+#include "keyfile.hpp"
+
+#define _(Text) gettext(Text) // _ as short version of gettext
+
+using namespace std;
+
+
+keyfile::keyfile()
+: keyfile_fd(-1), keyfile_map(MAP_FAILED), keyfile_maplength(0), keyfile_data(NULL)
+  {}
+
+keyfile::~keyfile() {
+   if ( keyfile_data )
+      gpgme_data_release(keyfile_data);
+   if ( keyfile_map != MAP_FAILED )
+      munmap(keyfile_map, keyfile_maplength);
+   if ( keyfile_fd >= 0 )
+      close(keyfile_fd);
+}
+
+/*
+Open the dump 'filename'.
+Binary dumps are mapped into memory and handed to gpgme without a copy,
+armored dumps are streamed through a read-callback; decoding the armor is
+left to gpg itself.
+*/
+int keyfile::open(string filename)
+{
+   struct stat fileinfo;
+   keyfile_fd = ::open(filename.c_str(), O_RDONLY);
+   if ( keyfile_fd < 0 || fstat(keyfile_fd, &fileinfo) != 0 ) {
+      cerr << _("Failed to open ") << filename << endl;
+      return 1;
+   }
+
+   // The first byte of a binary OpenPGP packet always has the high bit set
+   unsigned char first = 0;
+   bool binary = ( pread(keyfile_fd, &first, 1, 0) == 1 && (first & 0x80) );
+
+   if ( binary && fileinfo.st_size > 0 ) {
+      keyfile_maplength = fileinfo.st_size;
+      keyfile_map = mmap(NULL, keyfile_maplength, PROT_READ, MAP_PRIVATE, keyfile_fd, 0);
+      if ( keyfile_map != MAP_FAILED ) {
+         // the pages are touched only once, front to back
+         madvise(keyfile_map, keyfile_maplength, MADV_SEQUENTIAL);
+         if ( gpgme_data_new_from_mem(&keyfile_data, (const char*) keyfile_map,
+                                      keyfile_maplength, 0) == GPG_ERR_NO_ERROR )
+            return 0;
+         keyfile_data = NULL;
+      }
+   }
+
+   // Armored dump (or mapping failed): stream it
+   posix_fadvise(keyfile_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+   keyfile_cbs.read    = readcb;
+   keyfile_cbs.write   = NULL;
+   keyfile_cbs.seek    = seekcb;
+   keyfile_cbs.release = NULL;
+   if ( gpgme_data_new_from_cbs(&keyfile_data, &keyfile_cbs, this) != GPG_ERR_NO_ERROR ) {
+      keyfile_data = NULL;
+      cerr << _("Failed to open ") << filename << endl;
+      return 1;
+   }
+   return 0;
+}
+
+/*
+Go back to the start, to list the keys once more
+*/
+int keyfile::rewind()
+{
+   if ( gpgme_data_seek(keyfile_data, 0, SEEK_SET) != 0 )
+      return 1;
+   return 0;
+}
+
+/*
+Returns the data object to pass to gpgme_op_keylist_from_data_start
+*/
+gpgme_data_t keyfile::data()
+{
+   return keyfile_data;
+}
+
+ssize_t keyfile::readcb(void* handle, void* buffer, size_t size)
+{
+   keyfile* file = (keyfile*) handle;
+   return read(file->keyfile_fd, buffer, size);
+}
+
+off_t keyfile::seekcb(void* handle, off_t offset, int whence)
+{
+   keyfile* file = (keyfile*) handle;
+   return lseek(file->keyfile_fd, offset, whence);
+}
@@ -0,0 +1,51 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include <gpgme.h>
+using namespace std;
+
+#ifndef _keyfile_hpp_
+#define _keyfile_hpp_
+
+/*
+A file with exported keys (binary or armored), offered to gpgme as a data
+object which is read while gpg lists the keys, so even huge dumps need only
+constant memory.
+*/
+class keyfile{
+
+  public:
+    keyfile();
+    ~keyfile();
+    int open(string filename);
+    int rewind();
+    gpgme_data_t data();
+
+  private:
+    static ssize_t readcb(void*, void*, size_t);
+    static off_t seekcb(void*, off_t, int);
+
+    int    keyfile_fd;
+    void*  keyfile_map;	size_t keyfile_maplength;	// binary dumps are mapped
+    gpgme_data_t keyfile_data;
+    struct gpgme_data_cbs keyfile_cbs;
+};
+
+#endif
@@ -0,0 +1,47 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <vector>
+#include <string>
+using namespace std;
+
+#ifndef _keyrecord_hpp_
+#define _keyrecord_hpp_
+
+/*
+The parts of a key the auditor bases its decision on.
+Kept free of gpgme, so the auditor does not depend on where keys come from.
+*/
+struct keyrecord {
+   bool revoked;
+   bool expired;
+   bool invalid;	// invalid or disabled
+   bool disabled;
+   bool secret;	// a secret part is in the keyring
+   long created;	// creation time of the primary key
+   int validity;	// validity of the primary user-id
+   int owner_trust;
+   string keyid;	// long keyid of the primary key
+   string fpr;	// fingerprint of the primary key
+   vector<string> uids;	// all user-ids of the key
+   vector<string> emails;	// mail addresses of the user-ids
+   vector<int> emailvalidity;	// validity of the user-id of each address
+};
+
+#endif
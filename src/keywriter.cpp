@@ -0,0 +1,232 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+
+#include "keywriter.hpp"
+
+using namespace std;
+
+// Size at which the buffer is written out
+static const string::size_type buffersize = 1 << 20;
+
+
+keywriter::keywriter(int fd, int format)
+: writer_fd(fd), writer_format(format)
+{
+   writer_buffer.reserve(buffersize + 4096);
+}
+
+keywriter::~keywriter()
+{
+   flush();
+}
+
+/*
+Append one key together with the action taken on it
+*/
+void keywriter::write(const keyrecord& key, const char* action)
+{
+   if ( writer_format == FORMAT_JSON ) {
+      writer_buffer += "{\"fpr\":\"";
+      json(key.fpr);
+      writer_buffer += "\",\"keyid\":\"";
+      json(key.keyid);
+      writer_buffer += "\",\"uids\":[";
+      for ( vector<string>::size_type i = 0; i < key.uids.size(); i++ ) {
+         if ( i > 0 )
+            writer_buffer += ',';
+         writer_buffer += '"';
+         json(key.uids[i]);
+         writer_buffer += '"';
+      }
+      writer_buffer += "],\"revoked\":";
+      writer_buffer += key.revoked ? "true" : "false";
+      writer_buffer += ",\"expired\":";
+      writer_buffer += key.expired ? "true" : "false";
+      writer_buffer += ",\"invalid\":";
+      writer_buffer += key.invalid ? "true" : "false";
+      writer_buffer += ",\"validity\":";
+      number(key.validity);
+      writer_buffer += ",\"trust\":";
+      number(key.owner_trust);
+      writer_buffer += ",\"created\":";
+      number(key.created);
+      writer_buffer += ",\"action\":\"";
+      writer_buffer += action;
+      writer_buffer += "\"}\n";
+   }
+   else {
+      // key:fpr:flags:validity:trust:created:action:
+      writer_buffer += "key:";
+      writer_buffer += key.fpr;
+      writer_buffer += ':';
+      if ( key.revoked )
+         writer_buffer += 'r';
+      if ( key.expired )
+         writer_buffer += 'e';
+      if ( key.invalid )
+         writer_buffer += 'i';
+      writer_buffer += ':';
+      number(key.validity);
+      writer_buffer += ':';
+      number(key.owner_trust);
+      writer_buffer += ':';
+      number(key.created);
+      writer_buffer += ':';
+      writer_buffer += action;
+      writer_buffer += ":\n";
+      for ( vector<string>::size_type i = 0; i < key.uids.size(); i++ ) {
+         writer_buffer += "uid:";
+         colons(key.uids[i]);
+         writer_buffer += ":\n";
+      }
+   }
+   if ( writer_buffer.size() >= buffersize )
+      flush();
+}
+
+/*
+Append the statistics of the run, numberofkeys[validity][trust]
+*/
+void keywriter::statistics(int revokedkeys, int expiredkeys, int numberofkeys[6][6])
+{
+   long keys = 0;
+   for ( int i = 0; i < 6; i++ )
+      for ( int j = 0; j < 6; j++ )
+         keys += numberofkeys[i][j];
+   if ( writer_format == FORMAT_JSON ) {
+      writer_buffer += "{\"statistics\":{\"keys\":";
+      number(keys);
+      writer_buffer += ",\"revoked\":";
+      number(revokedkeys);
+      writer_buffer += ",\"expired\":";
+      number(expiredkeys);
+      writer_buffer += ",\"validity_trust\":[";
+      for ( int i = 0; i < 6; i++ ) {
+         writer_buffer += i > 0 ? ",[" : "[";
+         for ( int j = 0; j < 6; j++ ) {
+            if ( j > 0 )
+               writer_buffer += ',';
+            number(numberofkeys[i][j]);
+         }
+         writer_buffer += ']';
+      }
+      writer_buffer += "]}}\n";
+   }
+   else {
+      // stat:keys:revoked:expired: and valid:validity:keys of trust 0..5:
+      writer_buffer += "stat:";
+      number(keys);
+      writer_buffer += ':';
+      number(revokedkeys);
+      writer_buffer += ':';
+      number(expiredkeys);
+      writer_buffer += ":\n";
+      for ( int i = 0; i < 6; i++ ) {
+         writer_buffer += "valid:";
+         number(i);
+         for ( int j = 0; j < 6; j++ ) {
+            writer_buffer += ':';
+            number(numberofkeys[i][j]);
+         }
+         writer_buffer += ":\n";
+      }
+   }
+   if ( writer_buffer.size() >= buffersize )
+      flush();
+}
+
+/*
+Write out the buffer
+*/
+void keywriter::flush()
+{
+   const char* p = writer_buffer.data();
+   string::size_type left = writer_buffer.size();
+   while ( left > 0 ) {
+      ssize_t written = ::write(writer_fd, p, left);
+      if ( written < 0 ) {
+         if ( errno == EINTR )
+            continue;
+         break;
+      }
+      p    += written;
+      left -= written;
+   }
+   writer_buffer.clear();
+}
+
+/*
+Append a string escaped for JSON
+*/
+void keywriter::json(const string& s)
+{
+   for ( string::size_type i = 0; i < s.length(); i++ ) {
+      unsigned char c = s[i];
+      if ( c == '"' || c == '\\' ) {
+         writer_buffer += '\\';
+         writer_buffer += c;
+      }
+      else if ( c < 0x20 ) {
+         char hex[8];
+         snprintf(hex, sizeof(hex), "\\u%04x", c);
+         writer_buffer += hex;
+      }
+      else
+         writer_buffer += c;
+   }
+}
+
+/*
+Append a string escaped like gpg does in its colon listings
+*/
+void keywriter::colons(const string& s)
+{
+   for ( string::size_type i = 0; i < s.length(); i++ ) {
+      unsigned char c = s[i];
+      if ( c == ':' || c == '\\' || c < 0x20 ) {
+         char hex[8];
+         snprintf(hex, sizeof(hex), "\\x%02x", c);
+         writer_buffer += hex;
+      }
+      else
+         writer_buffer += c;
+   }
+}
+
+/*
+Append a number, without going through the locale
+*/
+void keywriter::number(long n)
+{
+   char digits[24];
+   int  pos = sizeof(digits);
+   bool negative = n < 0;
+   unsigned long u = negative ? -(unsigned long) n : n;
+   do {
+      digits[--pos] = '0' + u % 10;
+      u /= 10;
+   } while ( u > 0 );
+   if ( negative )
+      digits[--pos] = '-';
+   writer_buffer.append(digits + pos, sizeof(digits) - pos);
+}
@@ -0,0 +1,58 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include "keyrecord.hpp"
+using namespace std;
+
+#ifndef _keywriter_hpp_
+#define _keywriter_hpp_
+
+// Output formats
+enum {
+   FORMAT_HUMAN = 0,	// print_key
+   FORMAT_JSON,	// one JSON object per line
+   FORMAT_COLONS	// gpg like colon format
+};
+
+/*
+Writes keys in a machine readable format.
+All output is collected in one large buffer and written with few system
+calls; nothing is localised, so the output is the same in every locale.
+*/
+class keywriter{
+
+  public:
+    keywriter(int fd, int format);
+    ~keywriter();
+    void write(const keyrecord&, const char* action);
+    void statistics(int revokedkeys, int expiredkeys, int numberofkeys[6][6]);
+    void flush();
+
+  private:
+    void json(const string&);
+    void colons(const string&);
+    void number(long);
+
+    int    writer_fd;
+    int    writer_format;
+    string writer_buffer;
+};
+
+#endif
@@ -0,0 +1,105 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <libintl.h>
+
+#include "metrics.hpp"
+#include "stringutil.hpp"
+
+#define _(Text) gettext(Text) // _ as short version of gettext
+
+using namespace std;
+
+
+/*
+Write one metric with HELP and TYPE lines, the value is already formatted
+*/
+static void metric(FILE* out, const char* name, const char* help, const string& labels,
+                   const string& value)
+{
+   fprintf(out, "# HELP %s %s\n", name, help);
+   fprintf(out, "# TYPE %s gauge\n", name);
+   fprintf(out, "%s{%s} %s\n", name, labels.c_str(), value.c_str());
+}
+
+static string number(long long n)
+{
+   char buffer[32];
+   snprintf(buffer, sizeof(buffer), "%lld", n);
+   return buffer;
+}
+
+/*
+Write the metrics in the text format of the prometheus node_exporter
+(textfile collector). The file is replaced atomically, so the collector
+never sees half of it.
+*/
+int writemetrics(string file, const runmetrics& metrics)
+{
+   string tmpfile = file + ".tmp." + NumberToString(getpid());
+   FILE* out = fopen(tmpfile.c_str(), "w");
+   if ( !out ) {
+      cerr << _("Can't write metrics-file ") << file << endl;
+      return 1;
+   }
+   string keyring = "keyring=\"" + replace_string(replace_string(metrics.keyring, "\\", "\\\\"),
+                                                  "\"", "\\\"") + "\"";
+
+   fprintf(out, "# HELP gpgkeymgr_keys Number of keys by validity and ownertrust.\n");
+   fprintf(out, "# TYPE gpgkeymgr_keys gauge\n");
+   int total = 0;
+   for ( int i=0; i<6; i++)
+      for ( int j=0; j<6; j++) {
+         fprintf(out, "gpgkeymgr_keys{%s,validity=\"%d\",trust=\"%d\"} %d\n",
+                 keyring.c_str(), i, j, metrics.numberofkeys[i][j]);
+         total += metrics.numberofkeys[i][j];
+      }
+   metric(out, "gpgkeymgr_keys_total", "Number of keys in the keyring.",
+          keyring, number(total));
+   metric(out, "gpgkeymgr_revoked_keys", "Number of revoked keys.",
+          keyring, number(metrics.revokedkeys));
+   metric(out, "gpgkeymgr_expired_keys", "Number of expired keys.",
+          keyring, number(metrics.expiredkeys));
+   metric(out, "gpgkeymgr_deleted_keys", "Keys deleted by the last run.",
+          keyring, number(metrics.deleted));
+   metric(out, "gpgkeymgr_skipped_keys", "Secret keys skipped by the last run.",
+          keyring, number(metrics.skipped));
+   metric(out, "gpgkeymgr_errors", "Keys the last run failed to delete.",
+          keyring, number(metrics.errors));
+   metric(out, "gpgkeymgr_backup_bytes", "Bytes backed up by the last run.",
+          keyring, number(metrics.backupbytes));
+   // no floating point, the decimal point must not depend on the locale
+   char duration[32];
+   snprintf(duration, sizeof(duration), "%ld.%03ld", metrics.duration / 1000, metrics.duration % 1000);
+   metric(out, "gpgkeymgr_run_duration_seconds", "Duration of the last run.",
+          keyring, duration);
+   metric(out, "gpgkeymgr_last_run_timestamp_seconds", "End of the last run.",
+          keyring, number(time(NULL)));
+
+   if ( fclose(out) != 0 || rename(tmpfile.c_str(), file.c_str()) != 0 ) {
+      unlink(tmpfile.c_str());
+      cerr << _("Can't write metrics-file ") << file << endl;
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,41 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+using namespace std;
+
+#ifndef _metrics_hpp_
+#define _metrics_hpp_
+
+// Everything worth alerting on after a run
+struct runmetrics {
+   string keyring;	// gnupg home, used as label
+   int revokedkeys;
+   int expiredkeys;
+   int numberofkeys[6][6];	// validity x trust
+   long duration;	// ms
+   unsigned long deleted;
+   unsigned long skipped;	// secret keys
+   unsigned long errors;
+   long long backupbytes;
+};
+
+int writemetrics(string file, const runmetrics& metrics);
+
+#endif
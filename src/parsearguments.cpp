@@ -19,19 +19,106 @@
 
 #include <iostream>
 #include <iomanip>
+#include <fstream>
+#include <sstream>
 #include <unistd.h>
+#include <getopt.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <libintl.h>
 
 #include "parsearguments.hpp"
 #include "vectorutil.hpp"
+#include "keywriter.hpp"
+
+#define _(Text) gettext(Text) // _ as short version of gettext
 
 void help();
 
 using namespace std;
 
-int parsearguments(int argc, char *argv[], auditor& keyauditor,
-				 bool& dobackup, string& destination, bool& statistics, bool& onlystatistics,
-				 bool& quiet, bool& dry, bool& yes ) {
+// Values for options which only exist in long form
+enum {
+   OPT_FROMFILE = 256,
+   OPT_FORMAT,
+   OPT_CHECKPOINT,
+   OPT_RESUME,
+   OPT_PROGRESS,
+   OPT_STATUSFD,
+   OPT_METRICS,
+   OPT_LOWIMPACT,
+   OPT_MAXRATE,
+   OPT_DEADLINE,
+   OPT_SNAPSHOT,
+   OPT_DIFF,
+   OPT_TRUSTDB,
+   OPT_NOTRUSTDBCHECK,
+   OPT_COMPACT,
+   OPT_PRUNE,
+   OPT_LISTING,
+   OPT_WHATIF,
+   OPT_SAMPLE,
+   OPT_HISTORY,
+   OPT_TREND,
+   OPT_SINCE,
+   OPT_UNTIL
+};
+
+static const struct option long_options[] = {
+   { "from-file", required_argument, 0, OPT_FROMFILE },
+   { "format",    required_argument, 0, OPT_FORMAT },
+   { "checkpoint", required_argument, 0, OPT_CHECKPOINT },
+   { "resume",    no_argument,       0, OPT_RESUME },
+   { "progress",  no_argument,       0, OPT_PROGRESS },
+   { "status-fd", required_argument, 0, OPT_STATUSFD },
+   { "metrics",   required_argument, 0, OPT_METRICS },
+   { "low-impact", no_argument,      0, OPT_LOWIMPACT },
+   { "max-rate",  required_argument, 0, OPT_MAXRATE },
+   { "deadline",  required_argument, 0, OPT_DEADLINE },
+   { "snapshot",  required_argument, 0, OPT_SNAPSHOT },
+   { "diff",      required_argument, 0, OPT_DIFF },
+   { "trustdb",   optional_argument, 0, OPT_TRUSTDB },
+   { "no-trustdb-check", no_argument, 0, OPT_NOTRUSTDBCHECK },
+   { "compact",   no_argument,       0, OPT_COMPACT },
+   { "prune",     no_argument,       0, OPT_PRUNE },
+   { "listing",   required_argument, 0, OPT_LISTING },
+   { "what-if",   required_argument, 0, OPT_WHATIF },
+   { "sample",    required_argument, 0, OPT_SAMPLE },
+   { "history",   required_argument, 0, OPT_HISTORY },
+   { "trend",     required_argument, 0, OPT_TREND },
+   { "since",     required_argument, 0, OPT_SINCE },
+   { "until",     required_argument, 0, OPT_UNTIL },
+   { "help",      no_argument,       0, 'h' },
+   { 0, 0, 0, 0 }
+};
+
+options::options()
+: mode(MODE_CLEANUP), dobackup(false), destination(""), statistics(false), onlystatistics(false),
+  quiet(false), dry(false), yes(false), fromfile(""), format(FORMAT_HUMAN),
+  checkpoint(""), resume(false), progress(false), statusfd(-1),
+  metrics(""), lowimpact(false), maxrate(0),
+  deadline(0), usetrustdb(false), trustdb(""), trustdbcheck(true),
+  compact(false), prune(false), colons(false), whatif(""),
+  sample(0), history(""), since(0), until(0)
+  {}
+
+/*
+Read a date YYYY-MM-DD, local time. Returns the first second of the day,
+or -1 if the text is no date
+*/
+static long long parsedate(const char* text)
+{
+   struct tm day;
+   memset(&day, 0, sizeof(day));
+   const char* end = strptime(text, "%Y-%m-%d", &day);
+   if ( !end || *end )
+      return -1;
+   day.tm_isdst = -1;
+   return mktime(&day);
+}
+
+int parsearguments(int argc, char *argv[], auditor& keyauditor, options& opts) {
    bool revoked  = false;
    bool expired  = false;
    bool novalid  = false;	int max_valid = 0;
@@ -39,13 +126,10 @@ int parsearguments(int argc, char *argv[], auditor& keyauditor,
    bool altern   = false;
    bool poslist  = false;	vector<string> list_pos;
    bool neglist  = false;	vector<string> list_neg;
+   bool uidmatch = false;	uidmatcher uidpatterns;
+   bool superseded = false;
    
-   dobackup = false;	destination = "";
-   statistics = false; // Print out statistics
-   onlystatistics = false; 
-   quiet    = false;  // For quiet-mode
-   dry      = false;  // For dry-mode
-   yes      = false;  // For 'yes-mode'
+   opts = options();
 
    // Test if at least one argument has been given
    if ( argc == 1 ) {
@@ -54,9 +138,10 @@ int parsearguments(int argc, char *argv[], auditor& keyauditor,
    }
 
    opterr = 0;
-   char c;
+   int c;
    int tmp;
-   while ((c = getopt (argc, argv, "rev:t:oqydsb:l:x:h")) != -1) {
+   while ((c = getopt_long (argc, argv, "rev:t:onqydsb:l:x:u:h",
+                            long_options, NULL)) != -1) {
       switch (c)
          {
          case 'r':
@@ -82,24 +167,27 @@ int parsearguments(int argc, char *argv[], auditor& keyauditor,
          case 'o':
             altern = true;
             break;
+         case 'n':
+            superseded = true;
+            break;
          case 'q':
-            quiet = true;
+            opts.quiet = true;
             break;
          case 'y':
-            yes = true;
+            opts.yes = true;
             break;
          case 'd':
-            dry = true;
+            opts.dry = true;
             break;
          case 's':
-            statistics = true;
+            opts.statistics = true;
             break;
          case 'b':
-            dobackup=true;
+            opts.dobackup=true;
             if(optarg[0] == '-')
                optind--;
             else
-               destination = optarg;
+               opts.destination = optarg;
             break;
          case 'l':
             poslist=true;
@@ -111,6 +199,125 @@ int parsearguments(int argc, char *argv[], auditor& keyauditor,
             if ( readvector(optarg, list_neg) )
                return 2;
             break;
+         case 'u':
+            uidmatch=true;
+            if ( uidpatterns.readpatterns(optarg) )
+               return 2;
+            break;
+         case OPT_FROMFILE:
+            opts.fromfile = optarg;
+            break;
+         case OPT_FORMAT:
+            if ( string(optarg) == "json" )
+               opts.format = FORMAT_JSON;
+            else if ( string(optarg) == "colons" )
+               opts.format = FORMAT_COLONS;
+            else {
+               help();
+               return 1;
+            }
+            // informational output would break the format
+            opts.quiet = true;
+            break;
+         case OPT_CHECKPOINT:
+            opts.checkpoint = optarg;
+            break;
+         case OPT_RESUME:
+            opts.resume = true;
+            break;
+         case OPT_PROGRESS:
+            opts.progress = true;
+            break;
+         case OPT_STATUSFD:
+            if ( sscanf(optarg, "%d", &tmp) != 1 || tmp < 0 ) {
+               help();
+               return 1;
+            }
+            opts.statusfd = tmp;
+            break;
+         case OPT_METRICS:
+            opts.metrics = optarg;
+            break;
+         case OPT_LOWIMPACT:
+            opts.lowimpact = true;
+            break;
+         case OPT_MAXRATE:
+            if ( sscanf(optarg, "%lf", &opts.maxrate) != 1 || opts.maxrate <= 0 ) {
+               help();
+               return 1;
+            }
+            break;
+         case OPT_DEADLINE:
+            double seconds;
+            if ( sscanf(optarg, "%lf", &seconds) != 1 || seconds <= 0 ) {
+               help();
+               return 1;
+            }
+            opts.deadline = (long) (seconds * 1000);
+            break;
+         case OPT_SNAPSHOT:
+            opts.mode = MODE_SNAPSHOT;
+            opts.snapshot = optarg;
+            break;
+         case OPT_DIFF:
+            opts.mode = MODE_DIFF;
+            opts.difffiles.push_back(optarg);
+            break;
+         case OPT_TRUSTDB:
+            opts.usetrustdb = true;
+            if ( optarg )
+               opts.trustdb = optarg;
+            break;
+         case OPT_NOTRUSTDBCHECK:
+            opts.trustdbcheck = false;
+            break;
+         case OPT_COMPACT:
+            opts.compact = true;
+            break;
+         case OPT_PRUNE:
+            opts.prune = true;
+            break;
+         case OPT_LISTING:
+            if ( string(optarg) == "colons" )
+               opts.colons = true;
+            else if ( string(optarg) == "gpgme" )
+               opts.colons = false;
+            else {
+               help();
+               return 1;
+            }
+            break;
+         case OPT_WHATIF:
+            opts.mode = MODE_WHATIF;
+            opts.whatif = optarg;
+            break;
+         case OPT_SAMPLE:
+            if ( sscanf(optarg, "%ld", &opts.sample) != 1 || opts.sample <= 0 ) {
+               help();
+               return 1;
+            }
+            opts.mode = MODE_SAMPLE;
+            break;
+         case OPT_HISTORY:
+            opts.history = optarg;
+            break;
+         case OPT_TREND:
+            opts.mode = MODE_TREND;
+            opts.history = optarg;
+            break;
+         case OPT_SINCE:
+            if ( (opts.since = parsedate(optarg)) < 0 ) {
+               help();
+               return 1;
+            }
+            break;
+         case OPT_UNTIL:
+            if ( (opts.until = parsedate(optarg)) < 0 ) {
+               help();
+               return 1;
+            }
+            opts.until += 86400 - 1; // the whole day
+            break;
          case 'h':
             help();
             return -1;
@@ -121,7 +328,7 @@ int parsearguments(int argc, char *argv[], auditor& keyauditor,
             else if (optopt == 't')
                notrust = true;
             else if (optopt == 'b')
-               dobackup=true;
+               opts.dobackup=true;
             else {
                help();
                return 1;
@@ -132,11 +339,105 @@ int parsearguments(int argc, char *argv[], auditor& keyauditor,
              return 1;
          } } // end swich & loop
 
-   if ( !revoked && !expired && !novalid && !notrust && !poslist && !neglist && statistics )
-         onlystatistics=true;
+   bool notests = !revoked && !expired && !novalid && !notrust && !poslist && !neglist
+                  && !uidmatch && !superseded;
+   // --prune without tests prunes all keys
+   if ( notests && !opts.prune && (opts.statistics || opts.metrics != "" || opts.history != "") )
+         opts.onlystatistics=true;
+   // --compact without anything else to do
+   if ( notests && opts.compact && !opts.prune && !opts.onlystatistics && opts.mode == MODE_CLEANUP
+        && opts.fromfile == "" )
+         opts.mode = MODE_COMPACT;
+
+   // Keys of a dump are not in the keyring, so there is nothing to delete
+   if ( opts.fromfile != "" )
+         opts.dry=true;
+
+   // Only counts, but secret keys have to be known
+   if ( opts.mode == MODE_WHATIF ) {
+         opts.dry=true;
+         opts.onlystatistics=false;
+   }
+
+   if ( opts.resume && opts.checkpoint == "" ) {
+      help();
+      return 1;
+   }
+
+   // Samples are taken from the keybox of the keyring
+   if ( opts.mode == MODE_SAMPLE && opts.fromfile != "" ) {
+      help();
+      return 1;
+   }
+
+   // Estimates and hypothetical runs are no statistics of the keyring
+   if ( opts.history != "" && (opts.mode == MODE_SAMPLE || opts.mode == MODE_WHATIF) ) {
+      help();
+      return 1;
+   }
+
+   // The colon listing is read in one go, without cursor
+   if ( opts.colons && (opts.fromfile != "" || opts.checkpoint != "") ) {
+      help();
+      return 1;
+   }
 
    keyauditor.setvalues(altern, revoked, expired, novalid,
 					max_valid, notrust, max_trust, poslist,
-				 	list_pos, neglist, list_neg);
+				 	list_pos, neglist, list_neg, uidmatch, uidpatterns,
+					superseded);
+   return 0;
+}
+
+
+
+/*
+Read the rule sets for --what-if, one per line in the syntax of the
+command line (e.g. "-r -e -o" or "-v 1 -l list"), empty lines and lines
+starting with # are skipped. Every rule set gets its own auditor.
+*/
+int parserules(string file, vector<auditor>& rules, vector<string>& names)
+{
+   ifstream ifs( file.c_str() );
+   if (! ifs) {
+      cerr << _("Failed to open ") << file << endl;
+      return 1;
+   }
+   string line;
+   int line_counter = 0;
+   while (getline(ifs, line)) {
+      line_counter++;
+      istringstream words(line);
+      vector<string> tokens;
+      string word;
+      while ( words >> word )
+         tokens.push_back(word);
+      if ( tokens.empty() || tokens[0][0] == '#' )
+         continue;
+
+      vector<char*> args;
+      args.push_back((char*) "gpgkeymgr");
+      for ( vector<string>::size_type i = 0; i < tokens.size(); i++ )
+         args.push_back((char*) tokens[i].c_str());
+      args.push_back(NULL);
+      auditor rule;
+      options ruleopts;
+      optind = 0;	// getopt starts again
+      if ( parsearguments(args.size() - 1, &args[0], rule, ruleopts) != 0 ) {
+         cerr << file << ":" << line_counter << ": " << _("invalid rule set") << endl;
+         return 1;
+      }
+      // Options like -s or -y alone would select every key
+      if ( ruleopts.onlystatistics || !rule.hastests() ) {
+         cerr << file << ":" << line_counter << ": " << _("rule set without tests") << endl;
+         return 1;
+      }
+      rules.push_back(rule);
+      names.push_back(line.substr(line.find_first_not_of(" \t")));
+   }
+   if ( rules.empty() ) {
+      cerr << file << ": " << _("no rule sets") << endl;
+      return 1;
+   }
    return 0;
 }
@@ -19,4 +19,54 @@
 
 #include "auditor.hpp"
 
-int parsearguments(int, char**, auditor&, bool&, string&, bool&, bool&, bool&, bool&, bool& );
+#ifndef _parsearguments_hpp_
+#define _parsearguments_hpp_
+
+// What to do
+enum {
+   MODE_CLEANUP = 0,	// delete keys according to the tests
+   MODE_SNAPSHOT,	// save fingerprints and sketch of the keyring
+   MODE_DIFF,	// compare keyrings and snapshots
+   MODE_COMPACT,	// only compact the keybox
+   MODE_WHATIF,	// count the keys many rule sets would select
+   MODE_SAMPLE,	// statistics of a random sample of the keys
+   MODE_TREND	// print the statistics history
+};
+
+// Options which control the run itself, not the decision about a key
+struct options {
+   options();
+   int mode;
+   bool dobackup;	string destination;
+   bool statistics;	// Print out statistics
+   bool onlystatistics;	// Do nothing but statistics, implies statistics==true
+   bool quiet;	// For quiet-mode
+   bool dry;	// For dry-mode
+   bool yes;	// For 'yes-mode'
+   string fromfile;	// Audit the keys of an exported dump instead of the keyring
+   int format;	// Output format of the keys, see keywriter.hpp
+   string checkpoint;	// Save the state of the run here from time to time
+   bool resume;	// Continue the run saved in checkpoint
+   bool progress;	// Show a status line on the terminal
+   int statusfd;	// Write progress to this file descriptor, -1 for none
+   string metrics;	// Write metrics for prometheus to this file
+   bool lowimpact;	// Idle cpu and io priority
+   double maxrate;	// Deletes per second, 0 for no limit
+   long deadline;	// ms an operation on a key may take, 0 for no limit
+   string snapshot;	// MODE_SNAPSHOT: file to write
+   vector<string> difffiles;	// MODE_DIFF: snapshots to compare
+   bool usetrustdb;	string trustdb;	// Take trust and validity from trustdb.gpg, "" for the one of gpg
+   bool trustdbcheck;	// Let gpg check the trustdb when listing keys
+   bool compact;	// Drop the blobs of deleted keys from pubring.kbx
+   bool prune;	// Strip old subkeys, user-ids and signatures from the keys instead of deleting them
+   bool colons;	// List the keys with gpg --with-colons instead of gpgme
+   string whatif;	// MODE_WHATIF: file with one rule set per line
+   long sample;	// MODE_SAMPLE: number of keys to look at
+   string history;	// Append the statistics of the run to this file
+   long long since, until;	// MODE_TREND: time range of the runs to print, 0 for no limit
+};
+
+int parsearguments(int, char**, auditor&, options&);
+int parserules(string, vector<auditor>&, vector<string>&);
+
+#endif
@@ -0,0 +1,260 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <atomic>
+#include <fstream>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <libintl.h>
+#include <stdio.h>
+
+#include "progress.hpp"
+
+#define _(Text) gettext(Text) // _ as short version of gettext
+
+using namespace std;
+
+// Name of the file in the gnupg home caching the number of keys
+static const char* countfile = "/gpgkeymgr.keycount";
+// Minimal time between two updates of the status line/fd in ms
+static const long interval = 250;
+// Keys between two looks at the clock
+static const unsigned long tickmask = 63;
+
+/*
+The counters are only written by the main loop, but read by the handler of
+SIGUSR1 at any time, so they are lock-free atomics.
+*/
+static atomic<unsigned long> scanned(0), matched(0), deleted(0), skipped(0), failed(0);
+static bool   progress_statusline = false;
+static int    progress_statusfd   = -1;
+static long   progress_expected   = 0;
+static struct timespec progress_begin;
+static long   progress_last       = 0;	// ms of the last update
+
+// ms since progress_start
+static long elapsed()
+{
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (now.tv_sec - progress_begin.tv_sec) * 1000
+        + (now.tv_nsec - progress_begin.tv_nsec) / 1000000;
+}
+
+// Append 'n' to 'buffer' at 'pos', async-signal-safe
+static int appendnumber(char* buffer, int pos, unsigned long n)
+{
+   char digits[24];
+   int len = 0;
+   do {
+      digits[len++] = '0' + n % 10;
+      n /= 10;
+   } while ( n > 0 );
+   while ( len > 0 )
+      buffer[pos++] = digits[--len];
+   return pos;
+}
+
+static int appendtext(char* buffer, int pos, const char* text)
+{
+   int len = strlen(text);
+   memcpy(buffer + pos, text, len);
+   return pos + len;
+}
+
+/*
+Format a status-fd line like gpg's [GNUPG:] lines, async-signal-safe
+*/
+static int formatstatus(char* buffer)
+{
+   long ms = elapsed();
+   unsigned long keys = scanned.load(memory_order_relaxed);
+   unsigned long rate = ms > 0 ? keys * 1000 / ms : 0;
+   int pos = appendtext(buffer, 0, "[GPGKEYMGR:] PROGRESS scanned=");
+   pos = appendnumber(buffer, pos, keys);
+   pos = appendtext(buffer, pos, " matched=");
+   pos = appendnumber(buffer, pos, matched.load(memory_order_relaxed));
+   pos = appendtext(buffer, pos, " deleted=");
+   pos = appendnumber(buffer, pos, deleted.load(memory_order_relaxed));
+   pos = appendtext(buffer, pos, " skipped=");
+   pos = appendnumber(buffer, pos, skipped.load(memory_order_relaxed));
+   pos = appendtext(buffer, pos, " rate=");
+   pos = appendnumber(buffer, pos, rate);
+   if ( progress_expected > 0 && rate > 0 ) {
+      long left = progress_expected - (long) keys;
+      pos = appendtext(buffer, pos, " eta=");
+      pos = appendnumber(buffer, pos, left > 0 ? left / rate : 0);
+   }
+   buffer[pos++] = '\n';
+   return pos;
+}
+
+static void writeall(int fd, const char* buffer, int len)
+{
+   while ( len > 0 ) {
+      ssize_t written = write(fd, buffer, len);
+      if ( written <= 0 )
+         return;
+      buffer += written;
+      len    -= written;
+   }
+}
+
+/*
+SIGUSR1: dump the counters, even if gpg is busy right now
+*/
+static void dumpprogress(int)
+{
+   char buffer[256];
+   int len = formatstatus(buffer);
+   writeall(progress_statusfd >= 0 ? progress_statusfd : STDERR_FILENO, buffer, len);
+}
+
+/*
+Draw the status line on the terminal
+*/
+static void drawstatusline()
+{
+   long ms = elapsed();
+   unsigned long keys = scanned.load(memory_order_relaxed);
+   double rate = ms > 0 ? keys * 1000.0 / ms : 0;
+   fprintf(stderr, _("\r%lu keys scanned, %lu matched, %lu deleted, %lu skipped, %.0f keys/s"),
+           keys, matched.load(memory_order_relaxed), deleted.load(memory_order_relaxed),
+           skipped.load(memory_order_relaxed), rate);
+   if ( progress_expected > (long) keys && rate > 0 ) {
+      long eta = (progress_expected - keys) / rate;
+      fprintf(stderr, _(", ETA %ld:%02ld"), eta / 60, eta % 60);
+   }
+   fprintf(stderr, "\e[K");
+   fflush(stderr);
+}
+
+/*
+Start counting; the status line is only drawn on a terminal,
+'expected' is the number of keys, if known, else 0
+*/
+void progress_start(bool statusline, int statusfd, long expected)
+{
+   progress_statusline = statusline && isatty(STDERR_FILENO);
+   progress_statusfd   = statusfd;
+   progress_expected   = expected;
+   clock_gettime(CLOCK_MONOTONIC, &progress_begin);
+
+   struct sigaction action;
+   memset(&action, 0, sizeof(action));
+   action.sa_handler = dumpprogress;
+   action.sa_flags   = SA_RESTART;
+   sigemptyset(&action.sa_mask);
+   sigaction(SIGUSR1, &action, NULL);
+}
+
+void progress_scanned()
+{
+   scanned.fetch_add(1, memory_order_relaxed);
+}
+
+void progress_matched()
+{
+   matched.fetch_add(1, memory_order_relaxed);
+}
+
+/*
+Count the result of remove_key
+*/
+void progress_result(int status)
+{
+   if ( status == 0 )
+      deleted.fetch_add(1, memory_order_relaxed);
+   else if ( status == 1 )
+      skipped.fetch_add(1, memory_order_relaxed);
+   else
+      failed.fetch_add(1, memory_order_relaxed);
+}
+
+/*
+Called for every key, updates the status line and fd now and then
+*/
+void progress_tick()
+{
+   if ( (!progress_statusline && progress_statusfd < 0)
+        || (scanned.load(memory_order_relaxed) & tickmask) != 0 )
+      return;
+   long ms = elapsed();
+   if ( ms - progress_last < interval )
+      return;
+   progress_last = ms;
+   if ( progress_statusline )
+      drawstatusline();
+   if ( progress_statusfd >= 0 ) {
+      char buffer[256];
+      writeall(progress_statusfd, buffer, formatstatus(buffer));
+   }
+}
+
+/*
+Final update, leaves the terminal on a new line
+*/
+void progress_finish()
+{
+   if ( progress_statusline ) {
+      drawstatusline();
+      fputc('\n', stderr);
+   }
+   if ( progress_statusfd >= 0 ) {
+      char buffer[256];
+      writeall(progress_statusfd, buffer, formatstatus(buffer));
+   }
+}
+
+/*
+Results of remove_key so far
+*/
+void progress_counts(unsigned long& deletedkeys, unsigned long& skippedkeys, unsigned long& failedkeys)
+{
+   deletedkeys = deleted.load(memory_order_relaxed);
+   skippedkeys = skipped.load(memory_order_relaxed);
+   failedkeys  = failed.load(memory_order_relaxed);
+}
+
+/*
+Number of keys the last complete run listed, 0 if unknown
+*/
+long progress_readcount(string homedir)
+{
+   long keys = 0;
+   ifstream ifs( (homedir + countfile).c_str() );
+   if ( ifs )
+      ifs >> keys;
+   return ifs ? keys : 0;
+}
+
+/*
+Remember the number of keys for the ETA of the next run
+*/
+void progress_savecount(string homedir, long keys)
+{
+   string file = homedir + countfile;
+   ofstream ofs( (file + ".tmp").c_str() );
+   ofs << keys << "\n";
+   ofs.close();
+   if ( !ofs.fail() )
+      rename((file + ".tmp").c_str(), file.c_str());
+}
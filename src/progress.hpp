@@ -0,0 +1,36 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+using namespace std;
+
+#ifndef _progress_hpp_
+#define _progress_hpp_
+
+void progress_start(bool statusline, int statusfd, long expected);
+void progress_scanned();
+void progress_matched();
+void progress_result(int status);
+void progress_tick();
+void progress_finish();
+void progress_counts(unsigned long& deleted, unsigned long& skipped, unsigned long& failed);
+long progress_readcount(string homedir);
+void progress_savecount(string homedir, long keys);
+
+#endif
@@ -0,0 +1,172 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include <vector>
+#include <string.h>
+#include <time.h>
+#include <gpgme.h>
+
+#include "prune.hpp"
+#include "stringutil.hpp"
+#include "throttle.hpp"
+
+using namespace std;
+
+// one context for all keys, a gpg --edit-key is started per key anyway,
+// so the sizes are only measured if asked for (two more gpg per key)
+static gpgme_ctx_t prune_ctx = NULL;
+static long long prune_total = 0;	// bytes saved by all keys
+
+// the commands for gpg --edit-key and how far it got
+struct pruneedit {
+   vector<string> commands;
+   vector<string>::size_type next;
+};
+
+/*
+Answer the prompts of gpg --edit-key, anything else than what our commands
+ask for cancels the edit
+*/
+static gpgme_error_t prune_edit(void *opaque, const char *keyword, const char *args, int fd)
+{
+   if ( fd < 0 )	// only a status line
+      return 0;
+   pruneedit* edit = (pruneedit*) opaque;
+   string reply;
+   if ( !strcmp(keyword, "GET_LINE") && !strcmp(args, "keyedit.prompt") )
+      reply = edit->next < edit->commands.size() ? edit->commands[edit->next++] : "quit";
+   else if ( !strcmp(keyword, "GET_BOOL") && ( !strcmp(args, "keyedit.remove.subkey.okay")
+                                            || !strcmp(args, "keyedit.remove.uid.okay")
+                                            || !strcmp(args, "keyedit.save.okay") ) )
+      reply = "Y";
+   else
+      return gpg_error(GPG_ERR_GENERAL);
+   reply += "\n";
+   if ( gpgme_io_writen(fd, reply.c_str(), reply.length()) < 0 )
+      return gpg_error_from_syserror();
+   return 0;
+}
+
+static ssize_t countbytes(void *handle, const void *, size_t size)
+{
+   *(long long*) handle += size;
+   return size;
+}
+
+/*
+Size of the key as exported, -1 on error
+*/
+static long long exportsize(gpgme_ctx_t ctx, const char* fpr)
+{
+   long long bytes = 0;
+   struct gpgme_data_cbs counter = { NULL, countbytes, NULL, NULL };
+   gpgme_data_t data;
+   if ( gpgme_data_new_from_cbs(&data, &counter, &bytes) )
+      return -1;
+   gpgme_error_t err = gpgme_op_export(ctx, fpr, 0, data);
+   gpgme_data_release(data);
+   return err ? -1 : bytes;
+}
+
+/*
+Strip expired and revoked subkeys, revoked user-ids (but not the last one)
+and all signatures but the newest self-signature (minimize) from 'key'.
+With 'measure', 'saved' gets the number of bytes the exported key shrank.
+returns 0 if pruned, 2 on error, 3 if it took too long and was cancelled
+*/
+int prune_key(gpgme_key_t key, watchdog& guard, bool measure, long long& saved)
+{
+   saved = 0;
+   if ( !prune_ctx ) {
+      if ( gpgme_new(&prune_ctx) )
+         return 2;
+      if ( gpgme_set_protocol(prune_ctx, GPGME_PROTOCOL_OpenPGP) ) {
+         prune_finish();
+         return 2;
+      }
+   }
+
+   pruneedit edit;
+   edit.next = 0;
+   int subkey = 1, dropkeys = 0;
+   for ( gpgme_subkey_t sub = key->subkeys->next; sub; sub = sub->next, subkey++ )
+      if ( sub->expired || sub->revoked ) {
+         edit.commands.push_back("key " + NumberToString(subkey));
+         dropkeys++;
+      }
+   if ( dropkeys )
+      edit.commands.push_back("delkey");
+   int uid = 1, dropuids = 0;
+   for ( gpgme_user_id_t id = key->uids; id; id = id->next, uid++ )
+      if ( id->revoked ) {
+         edit.commands.push_back("uid " + NumberToString(uid));
+         dropuids++;
+      }
+   if ( dropuids && dropuids < uid - 1 )
+      edit.commands.push_back("deluid");
+   else
+      // gpg keeps the last user-id, remove the selection again
+      for ( int i = 0; i < dropuids; i++ )
+         edit.commands.pop_back();
+   edit.commands.push_back("minimize");
+   edit.commands.push_back("save");
+
+   long long before = measure ? exportsize(prune_ctx, key->subkeys->fpr) : -1;
+   // gpg locks the keyring while saving
+   throttle_wait();
+   struct timespec begin, end;
+   clock_gettime(CLOCK_MONOTONIC, &begin);
+   guard.arm(prune_ctx);
+   gpgme_error_t err = gpgme_op_interact(prune_ctx, key, 0, prune_edit, &edit, NULL);
+   bool cancelled = guard.disarm();
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   throttle_gpgtime((end.tv_sec - begin.tv_sec) * 1000000 + (end.tv_nsec - begin.tv_nsec) / 1000);
+   if ( cancelled && gpg_err_code (err) == GPG_ERR_CANCELED ) {
+      // do not reuse a cancelled context
+      prune_finish();
+      guard.cancelled.push_back(key->subkeys->fpr);
+      return 3;
+   }
+   if ( err )
+      return 2;
+   long long after = before >= 0 ? exportsize(prune_ctx, key->subkeys->fpr) : -1;
+   if ( before >= 0 && after >= 0 )
+      saved = before - after;
+   prune_total += saved;
+   return 0;
+}
+
+/*
+Bytes saved by pruning so far
+*/
+long long prune_saved()
+{
+   return prune_total;
+}
+
+/*
+Release the context of the pruning
+*/
+void prune_finish()
+{
+   if ( prune_ctx )
+      gpgme_release(prune_ctx);
+   prune_ctx = NULL;
+}
@@ -0,0 +1,59 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "secretkeys.hpp"
+
+using namespace std;
+
+
+secretkeys::secretkeys()
+  {}
+
+/*
+List all secret keys of the keyring
+*/
+gpgme_error_t secretkeys::load(gpgme_ctx_t ctx)
+{
+   gpgme_key_t key;
+   gpgme_error_t err = gpgme_op_keylist_start (ctx, NULL, 1);
+   while (!err) {
+      err = gpgme_op_keylist_next (ctx, &key);
+      if (err)
+         break;
+      if ( key->subkeys && key->subkeys->fpr )
+         secretkeys_fprs.insert(key->subkeys->fpr);
+      gpgme_key_release (key);
+   }
+   if ( gpg_err_code (err) == GPG_ERR_EOF )
+      return GPG_ERR_NO_ERROR;
+   return err;
+}
+
+/*
+Test if the key with fingerprint 'fpr' has a secret part
+*/
+bool secretkeys::contains(const string& fpr) const
+{
+   return secretkeys_fprs.find(fpr) != secretkeys_fprs.end();
+}
+
+unsigned int secretkeys::size() const
+{
+   return secretkeys_fprs.size();
+}
@@ -0,0 +1,44 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include <unordered_set>
+#include <gpgme.h>
+using namespace std;
+
+#ifndef _secretkeys_hpp_
+#define _secretkeys_hpp_
+
+/*
+Fingerprints of all keys with a secret part, listed once at startup,
+so secret keys can be skipped without asking gpg to delete them.
+*/
+class secretkeys{
+
+  public:
+    secretkeys();
+    gpgme_error_t load(gpgme_ctx_t);
+    bool contains(const string& fpr) const;
+    unsigned int size() const;
+
+  private:
+    unordered_set<string> secretkeys_fprs;
+};
+
+#endif
@@ -0,0 +1,265 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <sstream>
+#include <stdio.h>
+#include <math.h>
+#include <libintl.h>
+
+#include "snapshot.hpp"
+
+#define _(Text) gettext(Text) // _ as short version of gettext
+
+using namespace std;
+
+// First line of every snapshot-file
+static const string magic = "gpgkeymgr-snapshot 1";
+// Number of hashes kept for the minhash
+static const vector<uint64_t>::size_type minhashsize = 128;
+// log2 of the number of HyperLogLog registers
+static const int hllbits = 10;
+
+
+/*
+64 bit hash of a key (FNV-1a, finished with the splitmix64 mixer)
+*/
+static uint64_t hashentry(const snapshotentry& entry)
+{
+   uint64_t h = 14695981039346656037ULL;
+   for ( string::size_type i = 0; i < entry.fpr.length(); i++ ) {
+      h ^= (unsigned char) entry.fpr[i];
+      h *= 1099511628211ULL;
+   }
+   h ^= entry.last_update;
+   h += 0x9e3779b97f4a7c15ULL;
+   h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+   h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+   return h ^ (h >> 31);
+}
+
+static bool lessfpr(const snapshotentry& a, const snapshotentry& b)
+{
+   return a.fpr < b.fpr;
+}
+
+
+keysketch::keysketch()
+: sketch_keys(0), sketch_xor(0), sketch_hll(1 << hllbits, 0)
+  {}
+
+void keysketch::add(const snapshotentry& entry)
+{
+   uint64_t h = hashentry(entry);
+   sketch_keys++;
+   sketch_xor ^= h;
+
+   // keep the smallest hashes
+   if ( sketch_minhash.size() < minhashsize || h < sketch_minhash.back() ) {
+      vector<uint64_t>::iterator pos = lower_bound(sketch_minhash.begin(), sketch_minhash.end(), h);
+      if ( pos == sketch_minhash.end() || *pos != h ) {
+         sketch_minhash.insert(pos, h);
+         if ( sketch_minhash.size() > minhashsize )
+            sketch_minhash.pop_back();
+      }
+   }
+
+   // HyperLogLog: register by the first bits, rank by the rest
+   unsigned int reg = h >> (64 - hllbits);
+   uint64_t rest = h << hllbits;
+   unsigned char rank = 1;
+   while ( rank <= 64 - hllbits && !(rest & (1ULL << 63)) ) {
+      rank++;
+      rest <<= 1;
+   }
+   if ( rank > sketch_hll[reg] )
+      sketch_hll[reg] = rank;
+}
+
+/*
+Same keys with the same last update (up to hash collisions)
+*/
+bool keysketch::equal(const keysketch& other) const
+{
+   return sketch_keys == other.sketch_keys && sketch_xor == other.sketch_xor;
+}
+
+/*
+Estimated Jaccard similarity, from the minhashes
+*/
+double keysketch::similarity(const keysketch& other) const
+{
+   if ( sketch_minhash.empty() && other.sketch_minhash.empty() )
+      return 1;
+   // smallest hashes of the union, count those in both sets
+   vector<uint64_t> all;
+   set_union(sketch_minhash.begin(), sketch_minhash.end(),
+             other.sketch_minhash.begin(), other.sketch_minhash.end(), back_inserter(all));
+   if ( all.size() > minhashsize )
+      all.resize(minhashsize);
+   unsigned int both = 0;
+   for ( vector<uint64_t>::size_type i = 0; i < all.size(); i++ )
+      if ( binary_search(sketch_minhash.begin(), sketch_minhash.end(), all[i]) &&
+           binary_search(other.sketch_minhash.begin(), other.sketch_minhash.end(), all[i]) )
+         both++;
+   return (double) both / all.size();
+}
+
+/*
+Number of different keys, estimated by the HyperLogLog counter
+*/
+double keysketch::estimate() const
+{
+   double m = sketch_hll.size();
+   double sum = 0;
+   unsigned int zeros = 0;
+   for ( vector<unsigned char>::size_type i = 0; i < sketch_hll.size(); i++ ) {
+      sum += ldexp(1.0, -sketch_hll[i]);
+      if ( sketch_hll[i] == 0 )
+         zeros++;
+   }
+   double e = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+   if ( e <= 2.5 * m && zeros > 0 )
+      e = m * log(m / zeros);	// linear counting for small sets
+   return e;
+}
+
+unsigned long keysketch::keys() const
+{
+   return sketch_keys;
+}
+
+void keysketch::write(ostream& out) const
+{
+   char hex[20];
+   out << "keys " << sketch_keys << "\n";
+   snprintf(hex, sizeof(hex), "%016llx", (unsigned long long) sketch_xor);
+   out << "xor " << hex << "\n";
+   out << "minhash";
+   for ( vector<uint64_t>::size_type i = 0; i < sketch_minhash.size(); i++ ) {
+      snprintf(hex, sizeof(hex), " %016llx", (unsigned long long) sketch_minhash[i]);
+      out << hex;
+   }
+   out << "\n" << "hll ";
+   for ( vector<unsigned char>::size_type i = 0; i < sketch_hll.size(); i++ ) {
+      snprintf(hex, sizeof(hex), "%02x", sketch_hll[i]);
+      out << hex;
+   }
+   out << "\n";
+}
+
+bool keysketch::read(istream& in)
+{
+   string s, field;
+   unsigned long long value;
+   if ( !getline(in, s) || sscanf(s.c_str(), "keys %lu", &sketch_keys) != 1 )
+      return false;
+   if ( !getline(in, s) || sscanf(s.c_str(), "xor %llx", &value) != 1 )
+      return false;
+   sketch_xor = value;
+   if ( !getline(in, s) )
+      return false;
+   istringstream minhash(s);
+   minhash >> field;
+   if ( field != "minhash" )
+      return false;
+   sketch_minhash.clear();
+   while ( minhash >> hex >> value )
+      sketch_minhash.push_back(value);
+   if ( !getline(in, s) || s.compare(0, 4, "hll ") != 0
+        || s.length() != 4 + 2 * sketch_hll.size() )
+      return false;
+   for ( vector<unsigned char>::size_type i = 0; i < sketch_hll.size(); i++ ) {
+      unsigned int reg;
+      if ( sscanf(s.c_str() + 4 + 2 * i, "%2x", &reg) != 1 )
+         return false;
+      sketch_hll[i] = reg;
+   }
+   return true;
+}
+
+
+/*
+Open a snapshot-file and read its sketch
+*/
+int snapshotreader::open(string file)
+{
+   reader_stream.open( file.c_str() );
+   if (! reader_stream) {
+      cerr << _("Failed to open ") << file << endl;
+      return 1;
+   }
+   string s;
+   if ( !getline(reader_stream, s) || s != magic || !reader_sketch.read(reader_stream) ) {
+      cerr << _("Not a snapshot-file: ") << file << endl;
+      return 1;
+   }
+   return 0;
+}
+
+/*
+Read the next key, false at the end
+*/
+bool snapshotreader::next(snapshotentry& entry)
+{
+   string s;
+   if ( !getline(reader_stream, s) )
+      return false;
+   istringstream line(s);
+   line >> entry.fpr >> entry.last_update;
+   return !line.fail();
+}
+
+const keysketch& snapshotreader::sketch() const
+{
+   return reader_sketch;
+}
+
+
+/*
+Sort by fingerprint, the order all snapshots use
+*/
+void snapshot_sort(vector<snapshotentry>& entries)
+{
+   sort(entries.begin(), entries.end(), lessfpr);
+}
+
+/*
+Write a snapshot of the (sorted) keys, replacing the file atomically
+*/
+int snapshot_write(string file, const vector<snapshotentry>& entries)
+{
+   keysketch sketch;
+   for ( vector<snapshotentry>::size_type i = 0; i < entries.size(); i++ )
+      sketch.add(entries[i]);
+
+   string tmpfile = file + ".tmp";
+   ofstream ofs( tmpfile.c_str() );
+   ofs << magic << "\n";
+   sketch.write(ofs);
+   for ( vector<snapshotentry>::size_type i = 0; i < entries.size(); i++ )
+      ofs << entries[i].fpr << " " << entries[i].last_update << "\n";
+   ofs.close();
+   if ( ofs.fail() || rename(tmpfile.c_str(), file.c_str()) != 0 ) {
+      cerr << _("Can't write snapshot-file ") << file << endl;
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,78 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <stdint.h>
+using namespace std;
+
+#ifndef _snapshot_hpp_
+#define _snapshot_hpp_
+
+// One key of a snapshot
+struct snapshotentry {
+   string fpr;
+   unsigned long last_update;
+};
+
+/*
+Small summary of a set of keys: the number of keys, the xor of the hashes
+of all (fingerprint, last_update) pairs, the 128 smallest hashes (minhash)
+and a HyperLogLog counter. Equal sets have equal sketches, so keyrings of a
+fleet can be compared without listing them.
+*/
+class keysketch{
+
+  public:
+    keysketch();
+    void add(const snapshotentry&);
+    bool equal(const keysketch&) const;
+    double similarity(const keysketch&) const;
+    double estimate() const;
+    unsigned long keys() const;
+    void write(ostream&) const;
+    bool read(istream&);
+
+  private:
+    unsigned long     sketch_keys;
+    uint64_t          sketch_xor;
+    vector<uint64_t>  sketch_minhash;	// sorted, at most 'minhashsize'
+    vector<unsigned char> sketch_hll;	// registers
+};
+
+/*
+Reads a snapshot-file, the keys one after another in sorted order
+*/
+class snapshotreader{
+
+  public:
+    int open(string file);
+    bool next(snapshotentry&);
+    const keysketch& sketch() const;
+
+  private:
+    ifstream  reader_stream;
+    keysketch reader_sketch;
+};
+
+void snapshot_sort(vector<snapshotentry>&);
+int snapshot_write(string file, const vector<snapshotentry>&);
+
+#endif
@@ -0,0 +1,138 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <libintl.h>
+
+#include "throttle.hpp"
+
+#define _(Text) gettext(Text) // _ as short version of gettext
+
+using namespace std;
+
+// see linux/ioprio.h, glibc has no wrapper
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_BE    2
+#define IOPRIO_CLASS_SHIFT 13
+
+/*
+Token bucket limiting the deletes per second; every delete is one gpg
+process which locks the keyring only while it runs, so the pauses between
+them are the time other gpg processes can use the keyring.
+*/
+static double throttle_rate   = 0;	// deletes per second, 0 for no limit
+static double throttle_tokens = 0;
+static struct timespec throttle_last;
+static vector<long> throttle_gpgtimes;	// µs per gpg run changing the keyring
+static bool   throttle_active = false;
+
+static double seconds(const struct timespec& t)
+{
+   return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/*
+Run with the lowest cpu and io priority, gpg inherits both.
+Not the idle classes: gpg holds the lock of the keyring while it runs, and
+an idle gpg could hold it for long under load, blocking everybody else.
+*/
+int throttle_lowpriority()
+{
+   int fail = 0;
+   if ( setpriority(PRIO_PROCESS, 0, 19) != 0 )
+      fail = 1;
+#ifdef SYS_ioprio_set
+   if ( syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT | 7) != 0 )
+      fail = 1;
+#endif
+   if ( fail )
+      cerr << _("Warning: can't lower the priority") << endl;
+   throttle_active = true;
+   return fail;
+}
+
+/*
+Allow 'rate' deletes per second, bursts up to one second worth of deletes
+*/
+void throttle_start(double rate)
+{
+   throttle_rate   = rate;
+   throttle_tokens = rate < 1 ? 1 : rate;
+   throttle_active = true;
+   clock_gettime(CLOCK_MONOTONIC, &throttle_last);
+}
+
+/*
+Wait until the next delete is allowed
+*/
+void throttle_wait()
+{
+   if ( throttle_rate <= 0 )
+      return;
+   double burst = throttle_rate < 1 ? 1 : throttle_rate;
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   throttle_tokens += (seconds(now) - seconds(throttle_last)) * throttle_rate;
+   if ( throttle_tokens > burst )
+      throttle_tokens = burst;
+   throttle_last = now;
+   if ( throttle_tokens < 1 ) {
+      double wait = (1 - throttle_tokens) / throttle_rate;
+      struct timespec pause;
+      pause.tv_sec  = (time_t) wait;
+      pause.tv_nsec = (long) ((wait - pause.tv_sec) * 1e9);
+      nanosleep(&pause, NULL);
+      clock_gettime(CLOCK_MONOTONIC, &throttle_last);
+      throttle_tokens = 1;
+   }
+   throttle_tokens -= 1;
+}
+
+/*
+Record how long a gpg run changing the keyring took
+*/
+void throttle_gpgtime(long us)
+{
+   if ( throttle_active )
+      throttle_gpgtimes.push_back(us);
+}
+
+/*
+Print the distribution of the times gpg took per key
+*/
+void throttle_report()
+{
+   if ( !throttle_active || throttle_gpgtimes.empty() )
+      return;
+   vector<long> times = throttle_gpgtimes;
+   sort(times.begin(), times.end());
+   vector<long>::size_type n = times.size();
+   cout << _("Time of gpg per key (ms): ");
+   cout << "min " << times[0] / 1000.0;
+   cout << ", median " << times[n / 2] / 1000.0;
+   cout << ", p90 " << times[n * 9 / 10] / 1000.0;
+   cout << ", p99 " << times[n * 99 / 100] / 1000.0;
+   cout << ", max " << times[n - 1] / 1000.0 << endl;
+}
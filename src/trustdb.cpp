@@ -0,0 +1,250 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <libintl.h>
+
+#include "trustdb.hpp"
+
+#define _(Text) gettext(Text) // _ as short version of gettext
+
+using namespace std;
+
+// see g10/tdbio.h of gnupg
+static const size_t recordlength = 40;
+static const unsigned char rectype_version = 1;
+static const unsigned char rectype_htbl    = 10;
+static const unsigned char rectype_hlst    = 11;
+static const unsigned char rectype_trust   = 12;
+static const unsigned char rectype_valid   = 13;
+static const unsigned char trust_mask      = 15;
+static const size_t version_htable  = 36;	// offset of the hash table in the version record
+static const size_t htbl_items      = (recordlength - 2) / 4;	// per hash table record
+static const size_t hlst_items      = (recordlength - 2 - 5) / 5;	// per hash list record
+
+/*
+gpg counts unknown, expired, undefined, never, marginal, fully, ultimate
+from 0 to 6, gpgme has no 'expired'
+*/
+static unsigned char togpgme(unsigned char trust)
+{
+   trust &= trust_mask;
+   if ( trust <= 1 )
+      return 0;
+   if ( trust > 6 )
+      return 0;
+   return trust - 1;
+}
+
+static unsigned long readulong(const unsigned char* p)
+{
+   return ((unsigned long) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static int hexvalue(char c)
+{
+   if ( c >= '0' && c <= '9' )
+      return c - '0';
+   if ( c >= 'A' && c <= 'F' )
+      return c - 'A' + 10;
+   if ( c >= 'a' && c <= 'f' )
+      return c - 'a' + 10;
+   return -1;
+}
+
+
+trustdb::trustdb()
+: trustdb_map(NULL), trustdb_length(0), trustdb_records(0)
+  {}
+
+trustdb::~trustdb()
+{
+   if ( trustdb_map )
+      munmap((void*) trustdb_map, trustdb_length);
+}
+
+/*
+Map the file and check that it is a trustdb, NULL on error
+*/
+const unsigned char* trustdb::map(string file)
+{
+   int fd = ::open(file.c_str(), O_RDONLY);
+   struct stat fileinfo;
+   if ( fd < 0 || fstat(fd, &fileinfo) != 0 ) {
+      cerr << _("Failed to open ") << file << endl;
+      if ( fd >= 0 )
+         close(fd);
+      return NULL;
+   }
+   trustdb_length  = fileinfo.st_size;
+   trustdb_records = trustdb_length / recordlength;
+   void* map = trustdb_records > 0 ? mmap(NULL, trustdb_length, PROT_READ, MAP_PRIVATE, fd, 0)
+                                   : MAP_FAILED;
+   close(fd);
+   if ( map == MAP_FAILED ) {
+      cerr << _("Failed to open ") << file << endl;
+      return NULL;
+   }
+   const unsigned char* db = (const unsigned char*) map;
+   if ( db[0] != rectype_version || db[1] != 'g' || db[2] != 'p' || db[3] != 'g' ) {
+      cerr << _("Not a trustdb: ") << file << endl;
+      munmap(map, trustdb_length);
+      return NULL;
+   }
+   return db;
+}
+
+/*
+Ownertrust and validity of the trust record 'record' of the mapped file.
+The validity of a key is the best validity of its user-ids, as gpg
+caches it in the valid records of the key.
+*/
+trustdb::trustvalues trustdb::values(size_t record) const
+{
+   const unsigned char* rec = trustdb_map + record * recordlength;
+   trustvalues values;
+   values.owner_trust = togpgme(rec[22]);
+   // walk the list of valid records
+   unsigned char best = 0;
+   unsigned long next = readulong(rec + 26);
+   for ( size_t steps = 0; next > 0 && next < trustdb_records && steps < trustdb_records; steps++ ) {
+      const unsigned char* valid = trustdb_map + next * recordlength;
+      if ( valid[0] != rectype_valid )
+         break;
+      if ( (valid[22] & trust_mask) > best && (valid[22] & trust_mask) <= 6 )
+         best = valid[22] & trust_mask;
+      next = readulong(valid + 23);
+   }
+   values.validity = togpgme(best);
+   return values;
+}
+
+/*
+Map the trustdb and index all trust records
+*/
+int trustdb::open(string file)
+{
+   trustdb_map = map(file);
+   if ( !trustdb_map )
+      return 1;
+   trustdb_keys.reserve(trustdb_records / 4);
+   for ( size_t r = 1; r < trustdb_records; r++ )
+      if ( trustdb_map[r * recordlength] == rectype_trust )
+         trustdb_keys[string((const char*) trustdb_map + r * recordlength + 2, 20)] = values(r);
+   munmap((void*) trustdb_map, trustdb_length);
+   trustdb_map = NULL;
+   return 0;
+}
+
+/*
+Map the trustdb, keys are looked up in its hash table when asked for
+*/
+int trustdb::openmapped(string file)
+{
+   trustdb_map = map(file);
+   return trustdb_map ? 0 : 1;
+}
+
+/*
+Find the trust record of the (binary, 20 bytes) fingerprint like gpg does,
+see lookup_hashtable in g10/tdbio.c: every level of hash tables is indexed
+by the next byte of the fingerprint, its items are trust records, hash lists
+of trust records or hash tables of the next level.
+*/
+bool trustdb::hashlookup(const char* fpr, trustvalues& found) const
+{
+   size_t table = readulong(trustdb_map + version_htable);
+   for ( int level = 0; level < 20; level++ ) {
+      unsigned char msb = fpr[level];
+      size_t record = table + msb / htbl_items;
+      if ( table == 0 || record >= trustdb_records
+           || trustdb_map[record * recordlength] != rectype_htbl )
+         return false;
+      size_t item = readulong(trustdb_map + record * recordlength + 2 + 4 * (msb % htbl_items));
+      if ( item == 0 || item >= trustdb_records )
+         return false;
+      const unsigned char* rec = trustdb_map + item * recordlength;
+      if ( rec[0] == rectype_htbl ) {
+         table = item;
+         continue;
+      }
+      for ( size_t steps = 0; rec[0] == rectype_hlst && steps < trustdb_records; steps++ ) {
+         for ( size_t i = 0; i < hlst_items; i++ ) {
+            size_t member = readulong(rec + 6 + 4 * i);
+            if ( member > 0 && member < trustdb_records
+                 && trustdb_map[member * recordlength] == rectype_trust
+                 && !memcmp(trustdb_map + member * recordlength + 2, fpr, 20) ) {
+               found = values(member);
+               return true;
+            }
+         }
+         size_t next = readulong(rec + 2);
+         if ( next == 0 || next >= trustdb_records )
+            return false;
+         rec = trustdb_map + next * recordlength;
+      }
+      if ( rec[0] == rectype_trust && !memcmp(rec + 2, fpr, 20) ) {
+         found = values(item);
+         return true;
+      }
+      return false;
+   }
+   return false;
+}
+
+/*
+Look up the key with the fingerprint 'fpr' (hex), false if unknown
+*/
+bool trustdb::lookup(const string& fpr, int& validity, int& owner_trust) const
+{
+   // the trustdb stores the first 20 bytes of the fingerprint
+   if ( fpr.length() < 40 )
+      return false;
+   char key[20];
+   for ( int i = 0; i < 20; i++ ) {
+      int high = hexvalue(fpr[2*i]), low = hexvalue(fpr[2*i+1]);
+      if ( high < 0 || low < 0 )
+         return false;
+      key[i] = (high << 4) | low;
+   }
+   trustvalues found;
+   if ( trustdb_map ) {
+      if ( !hashlookup(key, found) )
+         return false;
+   }
+   else {
+      unordered_map<string, trustvalues>::const_iterator it = trustdb_keys.find(string(key, 20));
+      if ( it == trustdb_keys.end() )
+         return false;
+      found = it->second;
+   }
+   validity    = found.validity;
+   owner_trust = found.owner_trust;
+   return true;
+}
+
+unsigned int trustdb::size() const
+{
+   return trustdb_keys.size();
+}
@@ -0,0 +1,59 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include <unordered_map>
+using namespace std;
+
+#ifndef _trustdb_hpp_
+#define _trustdb_hpp_
+
+/*
+Read-only access to gpg's trustdb.gpg.
+The file is mapped and read once, ownertrust and the cached validity of all
+keys are then looked up by fingerprint, without gpg checking the trustdb.
+For a few keys, openmapped keeps the file mapped instead and looks them up
+in the hash table of gpg.
+*/
+class trustdb{
+
+  public:
+    trustdb();
+    ~trustdb();
+    int open(string file);
+    int openmapped(string file);
+    bool lookup(const string& fpr, int& validity, int& owner_trust) const;
+    unsigned int size() const;
+
+  private:
+    struct trustvalues {
+       unsigned char validity;	// as gpgme_validity_t
+       unsigned char owner_trust;
+    };
+    const unsigned char* map(string file);
+    trustvalues values(size_t record) const;
+    bool hashlookup(const char* fpr, trustvalues& found) const;
+
+    unordered_map<string, trustvalues> trustdb_keys;	// binary fingerprint (20 bytes)
+    const unsigned char* trustdb_map;	// openmapped: the file, else NULL
+    size_t trustdb_length;
+    size_t trustdb_records;
+};
+
+#endif
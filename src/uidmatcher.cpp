@@ -0,0 +1,266 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <map>
+#include <queue>
+#include <libintl.h>
+
+#include "uidmatcher.hpp"
+
+#define _(Text) gettext(Text) // _ as short version of gettext
+
+using namespace std;
+
+// Prefix marking a line of the pattern-file as regular expression
+static const string regexprefix = "re:";
+
+static inline unsigned char lower(unsigned char c)
+{
+   return ( c >= 'A' && c <= 'Z' ) ? c + ('a' - 'A') : c;
+}
+
+
+uidmatcher::uidmatcher()
+: havecombined(false)
+  {}
+
+uidmatcher::uidmatcher(const uidmatcher& other)
+: edge_start(other.edge_start), edge_chars(other.edge_chars),
+  edge_targets(other.edge_targets), fail(other.fail), ends(other.ends), depth(other.depth),
+  literals(other.literals), expressions(other.expressions), havecombined(false)
+{
+   compileregex();
+}
+
+uidmatcher& uidmatcher::operator=(const uidmatcher& other)
+{
+   if ( this == &other )
+      return *this;
+   edge_start   = other.edge_start;
+   edge_chars   = other.edge_chars;
+   edge_targets = other.edge_targets;
+   fail         = other.fail;
+   ends         = other.ends;
+   depth        = other.depth;
+   literals     = other.literals;
+   expressions  = other.expressions;
+   compileregex();
+   return *this;
+}
+
+uidmatcher::~uidmatcher()
+{
+   if ( havecombined )
+      regfree(&combined);
+}
+
+/*
+Read patterns from file, one per line.
+Lines starting with 're:' are extended regular expressions matched against
+the whole user-id, all others are mail domains the address of the user-id has
+to end with: 'example.org' also matches its subdomains, '@example.org' only
+the domain itself. Empty lines and lines starting with '#' are ignored.
+Matching is case-insensitive.
+*/
+int uidmatcher::readpatterns(string file)
+{
+   ifstream ifs( file.c_str() );
+
+   // check if the file is open
+   if (! ifs) {
+      cerr << _("Failed to open ") << file << endl;
+      return 1;
+   }
+
+   string s;
+   while (getline(ifs, s)) {
+      if ( s == "" || s[0] == '#' )
+         continue;
+      if ( s.compare(0, regexprefix.length(), regexprefix) == 0 )
+         expressions.push_back(s.substr(regexprefix.length()));
+      else
+         addliteral(s);
+   }
+   ifs.close();
+
+   build();
+   if ( !compileregex() ) {
+      cerr << _("Invalid regular expression in ") << file << endl;
+      return 1;
+   }
+   return 0;
+}
+
+void uidmatcher::addliteral(const string& literal)
+{
+   string s;
+   for ( string::size_type i = 0; i < literal.length(); i++ )
+      s += lower(literal[i]);
+   literals.push_back(s);
+}
+
+/*
+Build the Aho-Corasick automaton of all literals
+*/
+void uidmatcher::build()
+{
+   // Trie of all literals
+   vector< map<unsigned char, int> > trie(1);
+   ends.assign(1, false);
+   depth.assign(1, 0);
+   for ( vector<string>::size_type l = 0; l < literals.size(); l++ ) {
+      int node = 0;
+      for ( string::size_type i = 0; i < literals[l].length(); i++ ) {
+         unsigned char c = literals[l][i];
+         map<unsigned char, int>::iterator edge = trie[node].find(c);
+         if ( edge == trie[node].end() ) {
+            trie[node][c] = trie.size();
+            node = trie.size();
+            trie.push_back(map<unsigned char, int>());
+            ends.push_back(false);
+            depth.push_back(i + 1);
+         }
+         else
+            node = edge->second;
+      }
+      ends[node] = true;
+   }
+
+   // Failure links, breadth first
+   fail.assign(trie.size(), 0);
+   queue<int> todo;
+   for ( map<unsigned char, int>::iterator e = trie[0].begin(); e != trie[0].end(); e++ )
+      todo.push(e->second);
+   while ( !todo.empty() ) {
+      int node = todo.front();
+      todo.pop();
+      for ( map<unsigned char, int>::iterator e = trie[node].begin(); e != trie[node].end(); e++ ) {
+         int f = fail[node];
+         while ( f != 0 && trie[f].find(e->first) == trie[f].end() )
+            f = fail[f];
+         map<unsigned char, int>::iterator fe = trie[f].find(e->first);
+         fail[e->second] = ( fe != trie[f].end() && fe->second != e->second ) ? fe->second : 0;
+         todo.push(e->second);
+      }
+   }
+
+   // Flatten the edges into compact arrays
+   edge_start.assign(trie.size() + 1, 0);
+   edge_chars.clear();
+   edge_targets.clear();
+   for ( vector<int>::size_type n = 0; n < trie.size(); n++ ) {
+      edge_start[n] = edge_chars.size();
+      for ( map<unsigned char, int>::iterator e = trie[n].begin(); e != trie[n].end(); e++ ) {
+         edge_chars.push_back(e->first);
+         edge_targets.push_back(e->second);
+      }
+   }
+   edge_start[trie.size()] = edge_chars.size();
+}
+
+/*
+Compile all regular expressions into one alternation
+*/
+bool uidmatcher::compileregex()
+{
+   if ( havecombined )
+      regfree(&combined);
+   havecombined = false;
+   if ( expressions.empty() )
+      return true;
+   string all;
+   for ( vector<string>::size_type i = 0; i < expressions.size(); i++ ) {
+      if ( i > 0 )
+         all += "|";
+      all += "(" + expressions[i] + ")";
+   }
+   if ( regcomp(&combined, all.c_str(), REG_EXTENDED | REG_ICASE | REG_NOSUB) != 0 )
+      return false;
+   havecombined = true;
+   return true;
+}
+
+/*
+Test if the user-id 'uid' with the mail address 'email' ("" if it has none)
+matches one of the patterns: its address ends with a domain, or an
+expression matches the user-id
+*/
+bool uidmatcher::match(const string& uid, const string& email) const
+{
+   if ( !literals.empty() && email != "" ) {
+      int node = 0;
+      for ( string::size_type i = 0; i < email.length(); i++ ) {
+         unsigned char c = lower(email[i]);
+         for (;;) {
+            // binary search for the edge labeled c
+            int low = edge_start[node], high = edge_start[node+1] - 1, next = -1;
+            while ( low <= high ) {
+               int mid = (low + high) / 2;
+               if ( edge_chars[mid] < c )
+                  low = mid + 1;
+               else if ( edge_chars[mid] > c )
+                  high = mid - 1;
+               else {
+                  next = edge_targets[mid];
+                  break;
+               }
+            }
+            if ( next >= 0 ) {
+               node = next;
+               break;
+            }
+            if ( node == 0 )
+               break;
+            node = fail[node];
+         }
+      }
+      // the literals which end the address, the longest first
+      for ( ; node != 0; node = fail[node] ) {
+         string::size_type start = email.length() - depth[node];
+         if ( ends[node] && (start == 0 || email[start] == '@' || email[start] == '.'
+                             || email[start-1] == '@' || email[start-1] == '.') )
+            return true;
+      }
+   }
+   if ( havecombined )
+      return regexec(&combined, uid.c_str(), 0, NULL, 0) == 0;
+   return false;
+}
+
+/*
+Test if every user-id of a key matches one of the patterns. 'emails' holds
+the addresses of the user-ids in the same order, user-ids without one are
+left out there.
+*/
+bool uidmatcher::matchall(const vector<string>& uids, const vector<string>& emails) const
+{
+   if ( uids.empty() )
+      return false;
+   vector<string>::size_type e = 0;
+   for ( vector<string>::size_type i = 0; i < uids.size(); i++ ) {
+      string email;
+      if ( e < emails.size() && emails[e] != "" && uids[i].find(emails[e]) != string::npos )
+         email = emails[e++];
+      if ( !match(uids[i], email) )
+         return false;
+   }
+   return true;
+}
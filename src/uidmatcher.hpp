@@ -0,0 +1,65 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <vector>
+#include <string>
+#include <regex.h>
+using namespace std;
+
+#ifndef _uidmatcher_hpp_
+#define _uidmatcher_hpp_
+
+/*
+Matches user-ids against a (possibly huge) set of patterns in one pass.
+Mail domains are compiled into an Aho-Corasick automaton run over the mail
+address, regular expressions into one combined expression run over the
+user-id, so the cost per user-id does not depend on the number of patterns.
+*/
+class uidmatcher{
+
+  public:
+    uidmatcher();
+    uidmatcher(const uidmatcher&);
+    uidmatcher& operator=(const uidmatcher&);
+    ~uidmatcher();
+    int readpatterns(string file);
+    bool match(const string& uid, const string& email) const;
+    bool matchall(const vector<string>& uids, const vector<string>& emails) const;
+
+  private:
+    void addliteral(const string&);
+    void build();
+    bool compileregex();
+
+    // Automaton for the literals, edges of node n are
+    // edge_chars/edge_targets[edge_start[n] .. edge_start[n+1]-1], sorted by char
+    vector<int>           edge_start;
+    vector<unsigned char> edge_chars;
+    vector<int>           edge_targets;
+    vector<int>           fail;
+    vector<bool>          ends;	// node ends a literal
+    vector<int>           depth;	// length of the text leading to the node
+    vector<string>        literals;
+
+    // All regular expressions or-ed together
+    vector<string>        expressions;
+    regex_t               combined;	bool havecombined;
+};
+
+#endif
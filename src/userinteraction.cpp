@@ -22,6 +22,8 @@
 
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
+#include <math.h>
 #include <libintl.h>
 #define _(Text) gettext(Text) // _ as short version of gettext
 
@@ -81,6 +83,70 @@ void printstatistics(int revokedkeys, int expiredkeys, int numberofkeys[6][6]) {
 
 
 
+/*
+95% confidence interval of the share of 'hits' in a sample of 'n' out of
+'total' keys (Wilson score interval with finite population correction)
+*/
+static void confidence(long hits, long n, long total, double& low, double& high)
+{
+   const double z = 1.96;
+   low = high = 0;
+   if ( n <= 0 )
+      return;
+   double p = (double) hits / n;
+   double effective = n;	// the sample covers part of the population
+   if ( total > n && total > 1 )
+      effective = n * (double) (total - 1) / (total - n);
+   else if ( n >= total ) {
+      low = high = p;
+      return;
+   }
+   double denominator = 1 + z * z / effective;
+   double center = (p + z * z / (2 * effective)) / denominator;
+   double half   = z / denominator * sqrt(p * (1 - p) / effective
+                                          + z * z / (4 * effective * effective));
+   low  = max(0.0, center - half);
+   high = min(1.0, center + half);
+}
+
+/*
+Print the statistics of a sample of 'sampled' out of 'total' keys, scaled
+to the whole keyring, and the confidence intervals
+*/
+void printsampledstatistics(long total, long sampled, int revokedkeys, int expiredkeys,
+                            int numberofkeys[6][6]) {
+         int estimated[6][6];
+         double scale = sampled > 0 ? (double) total / sampled : 0;
+         for ( int i = 0; i < 6; i++ )
+            for ( int j = 0; j < 6; j++ )
+               estimated[i][j] = (int) (numberofkeys[i][j] * scale + 0.5);
+         printstatistics((int) (revokedkeys * scale + 0.5), (int) (expiredkeys * scale + 0.5),
+                         estimated);
+
+         cout << endl << _("Estimated from a sample of ") << sampled << _(" of ") << total
+              << _(" keys, 95% confidence intervals:") << endl;
+         double low, high;
+         cout << fixed << setprecision(1);
+         confidence(revokedkeys, sampled, total, low, high);
+         cout << _("Revoked keys: ") << 100.0 * revokedkeys / max(sampled, 1L)
+              << "% (" << 100 * low << "% - " << 100 * high << "%)" << endl;
+         confidence(expiredkeys, sampled, total, low, high);
+         cout << _("Expired keys: ") << 100.0 * expiredkeys / max(sampled, 1L)
+              << "% (" << 100 * low << "% - " << 100 * high << "%)" << endl;
+         for ( int i = 0; i < 6; i++ )
+            for ( int j = 0; j < 6; j++ ) {
+               if ( numberofkeys[i][j] == 0 )
+                  continue;
+               confidence(numberofkeys[i][j], sampled, total, low, high);
+               cout << _("Validity ") << i << _(", trust ") << j << ": "
+                    << 100.0 * numberofkeys[i][j] / sampled
+                    << "% (" << 100 * low << "% - " << 100 * high << "%)" << endl;
+            }
+         cout.unsetf(ios::fixed);
+}
+
+
+
 /*
 Print out help-Text
 */
@@ -92,6 +158,8 @@ void help()
                 "Before use, please backup your ~/.gnupg directory.\n") << endl;
    cout << _("Use: ");
    cout << program_name <<  " [-o] [-qysb] TEST [MORE TESTS…]\n";
+   cout << "     " << program_name <<  " --snapshot " << _("file") << "\n";
+   cout << "     " << program_name <<  " --diff " << _("file") << " [--diff " << _("file") << " …]\n";
 
    cout << "\t-b [dir]\t" << _("Backup public keyring")                 << endl;
    cout << "\t-o\t"       << _("remove key already "
@@ -101,6 +169,42 @@ void help()
    cout << "\t-d\t"       << _("Don't really do anything")              << endl;
    cout << "\t-s\t"       << _("Print statistics")                      << endl;
    cout << "\t-h\t"       << _("Print this help and exit")              << endl;
+   cout << "\t--from-file " << _("file")
+        << "\t"           << _("audit the keys of an exported dump, "
+                                   "not the keyring")                   << endl;
+   cout << "\t--format json|colons\t" << _("print keys in a machine "
+                                   "readable format")                   << endl;
+   cout << "\t--checkpoint " << _("file")
+        << "\t"           << _("save the state of the run from time to time")  << endl;
+   cout << "\t--resume\t" << _("continue the run saved in the checkpoint") << endl;
+   cout << "\t--progress\t" << _("show a status line with the progress") << endl;
+   cout << "\t--status-fd N\t" << _("write the progress to file descriptor N") << endl;
+   cout << "\t--metrics " << _("file")
+        << "\t"           << _("write statistics for prometheus to file") << endl;
+   cout << "\t--low-impact\t" << _("run with the lowest cpu and io priority") << endl;
+   cout << "\t--max-rate N\t" << _("delete at most N keys per second") << endl;
+   cout << "\t--deadline N\t" << _("cancel operations on a key after N seconds") << endl;
+   cout << "\t--trustdb[=" << _("file") << "]\t"
+                          << _("read trust and validity from trustdb.gpg") << endl;
+   cout << "\t--no-trustdb-check\t" << _("do not let gpg check the trustdb") << endl;
+   cout << "\t--compact\t" << _("remove the space of deleted keys from pubring.kbx") << endl;
+   cout << "\t--prune\t\t" << _("strip old subkeys, user-ids and signatures "
+                                   "instead of deleting keys")          << endl;
+   cout << "\t--sample N\t" << _("statistics estimated from N random keys") << endl;
+   cout << "\t--history " << _("file")
+        << "\t"           << _("append the statistics of the run to file") << endl;
+   cout << "\t--trend " << _("file")
+        << "\t"           << _("print how the statistics in file changed") << endl;
+   cout << "\t--since, --until YYYY-MM-DD\t" << _("time range for --trend") << endl;
+   cout << "\t--what-if " << _("file")
+        << "\t"           << _("count the keys each rule set in file would delete") << endl;
+   cout << "\t--listing gpgme|colons\t" << _("how to list the keys (colons: parse "
+                                             "gpg's colon listing on several threads)") << endl;
+   cout << "\t--snapshot " << _("file")
+        << "\t"           << _("save fingerprints of all keys to file") << endl;
+   cout << "\t--diff " << _("file")
+        << "\t"           << _("compare keyring with snapshot (give twice "
+                                   "to compare snapshots)")            << endl;
    cout                   << _("TESTs: ")                               << endl;
    cout << "\t-r\t"       << _("remove revoked keys")                   << endl;
    cout << "\t-e\t"       << _("remove expired keys")                   << endl;
@@ -108,6 +212,11 @@ void help()
         << "\t"           << _("remove keys listed in file (uids)")     << endl;
    cout << "\t-x "        << _("file")
         << "\t"           << _("do not remove keys listed in file (uids)")     << endl;
+   cout << "\t-u "        << _("file")
+        << "\t"           << _("remove keys whose user-ids all match "
+                                   "a pattern in file")                 << endl;
+   cout << "\t-n\t"       << _("remove keys superseded by a newer valid "
+                                   "key for the same mail address")     << endl;
    cout << "\t-v [N]\t"   << _("remove not-valid keys")                 << endl;
    cout << "\t-t [N]\t"   << _("remove not-trusted keys")               << endl;
    cout << "\t\t\t"       << _("with N you can increase the maximum level")
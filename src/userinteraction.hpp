@@ -24,3 +24,4 @@ using namespace std;
 bool ask_user(string question);
 void help();
 void printstatistics(int, int, int[6][6]);
+void printsampledstatistics(long, long, int, int, int[6][6]);
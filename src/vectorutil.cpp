@@ -34,7 +34,7 @@ using namespace std;
 Search if an value is included in the string list
 We use binary search as search algorithm
 */
-int searchvector(vector<string> str, string key)
+int searchvector(const vector<string>& str, const string& key)
 {
    int low, high, mid;
    low  = 0;
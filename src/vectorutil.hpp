@@ -21,6 +21,6 @@
 #include <string.h>
 using namespace std;
 
-int searchvector(vector<string> str, string key);
+int searchvector(const vector<string>& str, const string& key);
 int readvector(string file, vector<string>& vector);
 
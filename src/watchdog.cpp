@@ -0,0 +1,99 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "watchdog.hpp"
+
+using namespace std;
+
+
+watchdog::watchdog(long deadline)
+: watchdog_deadline(deadline), watchdog_ctx(NULL), watchdog_fired(false),
+  watchdog_stop(false)
+{
+   if ( watchdog_deadline > 0 )
+      watchdog_thread = thread(&watchdog::watch, this);
+}
+
+watchdog::~watchdog()
+{
+   if ( watchdog_thread.joinable() ) {
+      {
+         lock_guard<mutex> guard(watchdog_lock);
+         watchdog_stop = true;
+      }
+      watchdog_wakeup.notify_one();
+      watchdog_thread.join();
+   }
+}
+
+/*
+Start watching an operation on 'ctx'
+*/
+void watchdog::arm(gpgme_ctx_t ctx)
+{
+   if ( watchdog_deadline <= 0 )
+      return;
+   {
+      lock_guard<mutex> guard(watchdog_lock);
+      watchdog_ctx     = ctx;
+      watchdog_fired   = false;
+      watchdog_expires = chrono::steady_clock::now() + chrono::milliseconds(watchdog_deadline);
+   }
+   watchdog_wakeup.notify_one();
+}
+
+/*
+Operation is finished, returns true if it was cancelled
+*/
+bool watchdog::disarm()
+{
+   if ( watchdog_deadline <= 0 )
+      return false;
+   lock_guard<mutex> guard(watchdog_lock);
+   watchdog_ctx = NULL;
+   return watchdog_fired;
+}
+
+bool watchdog::enabled() const
+{
+   return watchdog_deadline > 0;
+}
+
+/*
+ms an operation may take, 0 for no limit
+*/
+long watchdog::deadline() const
+{
+   return watchdog_deadline;
+}
+
+void watchdog::watch()
+{
+   unique_lock<mutex> guard(watchdog_lock);
+   while ( !watchdog_stop ) {
+      if ( !watchdog_ctx )
+         watchdog_wakeup.wait(guard);
+      else if ( watchdog_wakeup.wait_until(guard, watchdog_expires) == cv_status::timeout
+                && watchdog_ctx && chrono::steady_clock::now() >= watchdog_expires ) {
+         gpgme_cancel_async(watchdog_ctx);
+         watchdog_fired = true;
+         watchdog_ctx   = NULL;
+      }
+   }
+}
@@ -0,0 +1,61 @@
+/*
+	gpgkeymgr
+	  A program to clean up an manage your keyring
+	  Copyright: Michael F. Schönitzer; 2011-2013
+*/
+/*  This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU Lesser General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU Lesser General Public License for more details.
+*
+*   You should have received a copy of the GNU Lesser General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <gpgme.h>
+using namespace std;
+
+#ifndef _watchdog_hpp_
+#define _watchdog_hpp_
+
+/*
+Cancels a gpgme operation which runs longer than its deadline.
+A thread waits for the deadline of the armed operation and calls
+gpgme_cancel_async, the operation then returns GPG_ERR_CANCELED.
+*/
+class watchdog{
+
+  public:
+    watchdog(long deadline);
+    ~watchdog();
+    void arm(gpgme_ctx_t);
+    bool disarm();
+    bool enabled() const;
+    long deadline() const;
+
+    vector<string> cancelled;	// fingerprints of keys whose operation was cancelled
+
+  private:
+    void watch();
+
+    long               watchdog_deadline;	// ms, 0 for none
+    gpgme_ctx_t        watchdog_ctx;	// armed operation, NULL if none
+    chrono::steady_clock::time_point watchdog_expires;
+    bool               watchdog_fired;
+    bool               watchdog_stop;
+    mutex              watchdog_lock;
+    condition_variable watchdog_wakeup;
+    thread             watchdog_thread;
+};
+
+#endif